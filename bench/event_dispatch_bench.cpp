@@ -0,0 +1,151 @@
+// Compares the cost per event of the previous EventManager (type_index
+// lookup, event copy and std::function) against the current one.
+
+#include "events.hpp"
+
+#include <chrono>
+#include <fmt/core.h>
+#include <functional>
+#include <string>
+#include <typeindex>
+#include <vector>
+
+namespace legacy {
+
+using peppe::Event;
+
+// Copy of the EventManager dispatch before it was made static
+class EventHandler {
+public:
+    using HandlerID = std::uintptr_t;
+
+    template<typename T, typename E>
+    explicit EventHandler(T* instance, void (T::*func)(E const&))
+        : handler_id{ id_counter++ }
+        , event_type_id{ typeid(E) }
+        , handler{ [instance, func](Event const& event) {
+            return (instance->*func)(static_cast<const E&>(event));
+        } } {}
+
+    static inline HandlerID id_counter = 0;
+
+    HandlerID handler_id;
+    std::type_index event_type_id;
+    std::function<void(Event const&)> handler;
+};
+
+class EventManager {
+public:
+    template<typename E>
+    static void send(E const& event) {
+        E e = event;
+        auto it = std::ranges::find_if(m_handlers, [](auto const& p) {
+            return p.first == typeid(E);
+        });
+
+        if (it != m_handlers.end()) {
+            for (auto const& event_handler : it->second) {
+                event_handler.handler(e);
+            }
+        }
+    }
+
+    static void add_listener(EventHandler&& event_handler) {
+        auto const event_type_id = event_handler.event_type_id;
+        auto it =
+            std::ranges::find_if(m_handlers, [event_type_id](auto const& p) {
+                return p.first == event_type_id;
+            });
+
+        if (it != m_handlers.end()) {
+            it->second.push_back(std::move(event_handler));
+        }
+        else {
+            m_handlers.emplace_back(
+                event_type_id, std::vector{ std::move(event_handler) }
+            );
+        }
+    }
+
+private:
+    using EventToHandlers =
+        std::pair<std::type_index, std::vector<EventHandler>>;
+    static inline std::vector<EventToHandlers> m_handlers = {};
+};
+
+} // namespace legacy
+
+// A few event types so the legacy lookup has something to search through
+template<int N>
+struct DummyEvent : public peppe::Event {
+    int value = N;
+};
+
+struct BenchEvent : public peppe::Event {
+    std::string from = "some peer name";
+    std::string message = "a typical chat message of a few dozen bytes";
+};
+
+struct Sink {
+    std::size_t total = 0;
+
+    void on_bench(BenchEvent const& event) { total += event.message.size(); }
+    template<int N>
+    void on_dummy(DummyEvent<N> const& event) {
+        total += std::size_t(event.value);
+    }
+};
+
+template<typename F>
+double ns_per_event(std::size_t iterations, F&& send) {
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i) {
+        send();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return double(std::chrono::nanoseconds(elapsed).count()) /
+           double(iterations);
+}
+
+template<int... N>
+void register_dummies(Sink& sink, std::integer_sequence<int, N...>) {
+    (legacy::EventManager::add_listener(
+         legacy::EventHandler(&sink, &Sink::on_dummy<N>)
+     ),
+     ...);
+    (peppe::EventManager::add_listener(
+         peppe::EventHandler<DummyEvent<N>>::template bind<&Sink::on_dummy<N>>(
+             &sink
+         )
+     ),
+     ...);
+}
+
+int main(int argc, const char* argv[]) {
+    const std::size_t iterations =
+        (argc > 1) ? std::stoull(argv[1]) : 10'000'000;
+
+    Sink sink;
+    register_dummies(sink, std::make_integer_sequence<int, 8>{});
+    legacy::EventManager::add_listener(
+        legacy::EventHandler(&sink, &Sink::on_bench)
+    );
+    peppe::EventManager::add_listener(
+        peppe::EventHandler<BenchEvent>::bind<&Sink::on_bench>(&sink)
+    );
+
+    const BenchEvent event;
+    const double legacy_ns = ns_per_event(iterations, [&event] {
+        legacy::EventManager::send(event);
+    });
+    const double current_ns = ns_per_event(iterations, [&event] {
+        peppe::EventManager::send(event);
+    });
+
+    fmt::print("iterations: {}\n", iterations);
+    fmt::print("legacy dispatch:  {:.2f} ns/event\n", legacy_ns);
+    fmt::print("current dispatch: {:.2f} ns/event\n", current_ns);
+    fmt::print("speedup:          {:.2f}x\n", legacy_ns / current_ns);
+    // Keeps the handlers from being optimized away
+    fmt::print("checksum: {}\n", sink.total);
+}
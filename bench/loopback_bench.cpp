@@ -0,0 +1,395 @@
+// Runs several nodes in one process, connected over loopback, drives
+// messages through their PeerListener and reports throughput and
+// end-to-end latency as JSON.
+//
+// Usage: PepperoniLoopbackBench [--nodes N] [--topology mesh|ring]
+//            [--rate MSG_PER_SEC] [--size BYTES] [--seconds S]
+//            [--threads T] [--port BASE_PORT] [--batch-window-us US]
+//            [--fanout F] [--compression 0|1] [--transport tcp|unix]
+//
+// Every message embeds its send time, every node receiving it records one
+// latency sample. Heap allocations made by the network threads are counted
+// over the second half of the run, once pools reached their steady state.
+// Session logs go to stderr, redirect it to keep the output clean.
+
+#include "chat_message.hpp"
+#include "events.hpp"
+#include "logger.hpp"
+#include "peer_listener.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Only the io_context threads are counted, not the driver
+std::atomic<std::uint64_t> network_allocations = 0;
+thread_local bool count_allocations = false;
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    if (count_allocations) {
+        network_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void* ptr = std::malloc(std::max<std::size_t>(size, 1))) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+using namespace peppe;
+using bench_clock = std::chrono::steady_clock;
+
+struct Options {
+    std::size_t nodes = 4;
+    std::string topology = "mesh";
+    // "tcp" or "unix" (Unix domain sockets)
+    std::string transport = "tcp";
+    double rate = 1000.0;
+    std::size_t size = 128;
+    double seconds = 5.0;
+    unsigned threads = 0;
+    int port = 26000;
+    std::int64_t batch_window_us = 2000;
+    std::int64_t fanout = 3;
+    bool compression = true;
+};
+
+// Hex encoded send time at the start of every message
+constexpr std::size_t timestamp_size = 16;
+
+std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               bench_clock::now().time_since_epoch()
+    )
+        .count();
+}
+
+std::string make_message(std::size_t size) {
+    auto text = fmt::format("{:016x}", std::uint64_t(now_ns()));
+    text.resize(std::max(size, timestamp_size), 'x');
+    return text;
+}
+
+// Collects the latency of every delivered message
+class LatencySink : public EventListener<LatencySink, BackendEvent> {
+public:
+    void on_event(const BackendEvent& event) override {
+        const auto received_ns = now_ns();
+        event.match(
+            [&](const ReceiveMessage& received) {
+                for (const auto text : received.message->texts()) {
+                    record(text, received_ns);
+                }
+            },
+            [this](const PeerConnected&) {
+                std::lock_guard lock(m_mutex);
+                ++m_connections;
+            },
+            [](const auto&) {}
+        );
+    }
+
+    [[nodiscard]] std::size_t connections() const {
+        std::lock_guard lock(m_mutex);
+        return m_connections;
+    }
+
+    [[nodiscard]] std::size_t delivered() const {
+        std::lock_guard lock(m_mutex);
+        return m_latencies_ns.size();
+    }
+
+    // Sorted latencies, received bytes and time of the last delivery
+    struct Results {
+        std::vector<std::int64_t> latencies_ns;
+        std::uint64_t bytes = 0;
+        std::int64_t last_ns = 0;
+    };
+
+    // Avoids counting the growth of the sample vector
+    void reserve(std::size_t count) {
+        std::lock_guard lock(m_mutex);
+        m_latencies_ns.reserve(count);
+    }
+
+    [[nodiscard]] Results take() {
+        std::lock_guard lock(m_mutex);
+        Results result{ std::move(m_latencies_ns), m_bytes, m_last_ns };
+        std::ranges::sort(result.latencies_ns);
+        return result;
+    }
+
+private:
+    void record(std::string_view text, std::int64_t received_ns) {
+        std::uint64_t sent_ns = 0;
+        const auto digits = text.substr(0, timestamp_size);
+        const auto [ptr, ec] = std::from_chars(
+            digits.data(), digits.data() + digits.size(), sent_ns, 16
+        );
+        if (ec != std::errc{}) {
+            return;
+        }
+        std::lock_guard lock(m_mutex);
+        m_latencies_ns.push_back(received_ns - std::int64_t(sent_ns));
+        m_bytes += text.size();
+        m_last_ns = std::max(m_last_ns, received_ns);
+    }
+
+    mutable std::mutex m_mutex;
+    std::size_t m_connections = 0;
+    std::vector<std::int64_t> m_latencies_ns;
+    std::uint64_t m_bytes = 0;
+    std::int64_t m_last_ns = 0;
+};
+
+Options parse_options(int argc, const char* argv[]) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string_view key = argv[i];
+        const std::string_view value = argv[i + 1];
+        const auto as_int = [&value] { return std::atoll(value.data()); };
+        if (key == "--nodes") {
+            options.nodes = std::max<std::size_t>(as_int(), 2);
+        }
+        else if (key == "--topology") {
+            options.topology = value;
+        }
+        else if (key == "--transport") {
+            options.transport = value;
+        }
+        else if (key == "--rate") {
+            options.rate = std::max(std::atof(value.data()), 1.0);
+        }
+        else if (key == "--size") {
+            options.size = std::size_t(as_int());
+        }
+        else if (key == "--seconds") {
+            options.seconds = std::atof(value.data());
+        }
+        else if (key == "--threads") {
+            options.threads = unsigned(as_int());
+        }
+        else if (key == "--port") {
+            options.port = int(as_int());
+        }
+        else if (key == "--batch-window-us") {
+            options.batch_window_us = as_int();
+        }
+        else if (key == "--fanout") {
+            options.fanout = as_int();
+        }
+        else if (key == "--compression") {
+            options.compression = as_int() != 0;
+        }
+        else {
+            fmt::print(stderr, "Unknown option '{}'\n", key);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    return options;
+}
+
+// Unix domain socket of node 'index'
+std::string socket_path(const Options& options, std::size_t index) {
+    return fmt::format(
+        "/tmp/pepperoni-bench-{}.sock", options.port + int(index)
+    );
+}
+
+// Peers dialed by node 'index'. Returns the number of connections.
+std::size_t dial_targets(
+    const Options& options,
+    std::size_t index,
+    PeerTable& peers
+) {
+    const auto add = [&](std::size_t target) {
+        if (options.transport == "unix") {
+            peers.push_back(Peer{ .local_path = socket_path(options, target) });
+            return;
+        }
+        peers.push_back(
+            Peer{ .host = "127.0.0.1", .port = options.port + int(target) }
+        );
+    };
+    if (options.topology == "ring") {
+        if (index > 0) {
+            add(index - 1);
+        }
+        else if (options.nodes > 2) {
+            add(options.nodes - 1);
+        }
+    }
+    else {
+        for (std::size_t target = 0; target < index; ++target) {
+            add(target);
+        }
+    }
+    return peers.size();
+}
+
+std::int64_t percentile(const std::vector<std::int64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    const auto rank = std::size_t(p * double(sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    const auto options = parse_options(argc, argv);
+    Logger::global().start(LoggerConfig{ .file = {}, .print_stderr = true });
+    const unsigned num_threads =
+        (options.threads > 0)
+            ? options.threads
+            : std::max(1U, std::thread::hardware_concurrency());
+
+    LatencySink sink;
+    asio::io_context io_context{ int(num_threads) };
+
+    // Start the nodes
+    BatchConfig batch;
+    batch.flush_window = std::chrono::microseconds(options.batch_window_us);
+    CompressionConfig compression;
+    compression.enabled = options.compression;
+    GossipConfig gossip;
+    gossip.fanout = std::size_t(std::max<std::int64_t>(options.fanout, 0));
+
+    std::vector<std::unique_ptr<PeerListener>> nodes;
+    std::size_t expected_connections = 0;
+    for (std::size_t i = 0; i < options.nodes; ++i) {
+        PeerTable peers;
+        expected_connections += dial_targets(options, i, peers);
+        auto node =
+            std::make_unique<PeerListener>(io_context, std::move(peers));
+        node->set_port(asio::ip::port_type(options.port + int(i)));
+        if (options.transport == "unix") {
+            node->set_unix_socket(socket_path(options, i));
+        }
+        node->set_client_name(fmt::format("node{}", i));
+        node->set_batch_config(batch);
+        node->set_compression_config(compression);
+        node->set_gossip_config(gossip);
+        co_spawn(io_context, node->listener(), detached);
+        nodes.push_back(std::move(node));
+    }
+
+    std::vector<std::jthread> workers;
+    for (unsigned i = 0; i < num_threads; ++i) {
+        workers.emplace_back([&io_context] {
+            count_allocations = true;
+            io_context.run();
+        });
+    }
+
+    // Both ends of a connection report it
+    const auto connect_deadline = bench_clock::now() + std::chrono::seconds(10);
+    while (sink.connections() < 2 * expected_connections) {
+        if (bench_clock::now() > connect_deadline) {
+            fmt::print(
+                stderr,
+                "Only {}/{} connections established\n",
+                sink.connections() / 2,
+                expected_connections
+            );
+            std::fflush(stderr);
+            std::quick_exit(EXIT_FAILURE);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    // Open loop: messages are sent at their scheduled time, round robin over
+    // the nodes, whether the previous ones were delivered or not
+    const auto interval = std::chrono::duration_cast<bench_clock::duration>(
+        std::chrono::duration<double>(1.0 / options.rate)
+    );
+    const auto total = std::size_t(options.rate * options.seconds);
+    // Every other node should receive every message
+    const auto expected = total * (options.nodes - 1);
+    sink.reserve(expected);
+    const auto start = bench_clock::now();
+    const auto start_ns = now_ns();
+    std::uint64_t allocations_start = 0;
+    std::size_t delivered_start = 0;
+    for (std::size_t i = 0; i < total; ++i) {
+        if (i == total / 2) {
+            allocations_start =
+                network_allocations.load(std::memory_order_relaxed);
+            delivered_start = sink.delivered();
+        }
+        std::this_thread::sleep_until(start + i * interval);
+        nodes[i % nodes.size()]->on_event(
+            FrontendEvent{ SendMessage{ make_message(options.size) } }
+        );
+    }
+
+    const auto drain_deadline = bench_clock::now() + std::chrono::seconds(5);
+    while (sink.delivered() < expected && bench_clock::now() < drain_deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    const auto allocations =
+        network_allocations.load(std::memory_order_relaxed) -
+        allocations_start;
+
+    auto results = sink.take();
+    const auto elapsed_s =
+        double(std::max(results.last_ns - start_ns, std::int64_t(1))) / 1e9;
+    const auto delivered = results.latencies_ns.size();
+    const auto measured_deliveries =
+        std::max<std::size_t>(delivered - delivered_start, 1);
+    const auto to_us = [](std::int64_t ns) { return double(ns) / 1e3; };
+    fmt::print(
+        "{{\"nodes\": {}, \"topology\": \"{}\", \"transport\": \"{}\", "
+        "\"threads\": {}, "
+        "\"rate\": {}, \"size\": {}, \"seconds\": {}, "
+        "\"sent\": {}, \"expected\": {}, \"delivered\": {}, "
+        "\"messages_per_sec\": {:.1f}, \"bytes_per_sec\": {:.1f}, "
+        "\"latency_us\": {{\"p50\": {:.1f}, \"p99\": {:.1f}, "
+        "\"p999\": {:.1f}, \"max\": {:.1f}}}, "
+        "\"allocations_per_message\": {:.2f}}}\n",
+        options.nodes,
+        options.topology,
+        options.transport,
+        num_threads,
+        options.rate,
+        options.size,
+        options.seconds,
+        total,
+        expected,
+        delivered,
+        double(delivered) / elapsed_s,
+        double(results.bytes) / elapsed_s,
+        to_us(percentile(results.latencies_ns, 0.5)),
+        to_us(percentile(results.latencies_ns, 0.99)),
+        to_us(percentile(results.latencies_ns, 0.999)),
+        to_us(results.latencies_ns.empty() ? 0 : results.latencies_ns.back()),
+        double(allocations) / double(measured_deliveries)
+    );
+    std::fflush(stdout);
+
+    // Sessions still running refer to their node's connection table, which
+    // the io_context teardown doesn't account for: skip it
+    std::fflush(stderr);
+    std::quick_exit(delivered < expected ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "memory.hpp"
+#include "message.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <ranges>
+#include <span>
+#include <string_view>
+
+namespace peppe {
+
+// Chat message shared by everything it goes through: events, the UI queue,
+// control socket subscribers and the peers it is relayed to. It is built
+// once and never modified: the encoded frame owns the bytes, the sender
+// and the texts are views over it.
+// A received message is written once, when its views over the receive
+// buffer are encoded into the frame, the frame carries the decremented ttl
+// so it is relayed as is.
+class ChatMessage {
+public:
+    using Texts = std::pmr::vector<std::string_view>;
+
+    // Ctor, see create()
+    ChatMessage(WireBuffer&& frame, std::pmr::memory_resource* resource)
+        : m_frame(std::move(frame))
+        , m_texts(resource)
+        , m_peer(resource) {}
+    // Copy
+    ChatMessage(ChatMessage const&) = delete;
+    ChatMessage& operator=(ChatMessage const&) = delete;
+    // Move
+    ChatMessage(ChatMessage&&) = delete;
+    ChatMessage& operator=(ChatMessage&&) = delete;
+    // Dtor
+    ~ChatMessage() = default;
+
+    // Encodes a TextMessage frame for a single text, a TextBatch frame
+    // otherwise. 'peer' is the sender when the header has no origin.
+    // Callers must keep 'texts' under TextBatch::TextList::max_size.
+    [[nodiscard]] static std::shared_ptr<const ChatMessage> create(
+        GossipHeader gossip,
+        std::string_view peer,
+        std::span<const std::string_view> texts
+    ) {
+        return create_from(gossip, peer, texts);
+    }
+    // Texts of a received batch, still views into its frame
+    [[nodiscard]] static std::shared_ptr<const ChatMessage> create(
+        GossipHeader gossip,
+        std::string_view peer,
+        const TextBatch::TextList::value_type& texts
+    ) {
+        return create_from(gossip, peer, texts);
+    }
+
+    [[nodiscard]] std::uint64_t id() const { return m_id; }
+    [[nodiscard]] std::string_view sender() const { return m_sender; }
+    [[nodiscard]] const Texts& texts() const { return m_texts; }
+    // TextMessage or TextBatch frame of the message
+    [[nodiscard]] const WireBuffer& frame() const { return m_frame; }
+
+private:
+    template<typename Texts>
+    [[nodiscard]] static std::shared_ptr<const ChatMessage> create_from(
+        GossipHeader gossip,
+        std::string_view peer,
+        const Texts& texts
+    ) {
+        auto& resource = pool();
+        gossip.origin =
+            truncated(gossip.origin, String<std::uint8_t>::max_size);
+        const auto truncated_texts =
+            texts | std::views::transform([](std::string_view text) {
+                return truncated(text, String<std::uint32_t>::max_size);
+            });
+        WireBuffer frame;
+        if (texts.size() == 1) {
+            const TextMessage msg{
+                .gossip = gossip,
+                .text = *truncated_texts.begin(),
+            };
+            frame = encode(msg);
+        }
+        else {
+            frame = FramePool::global().make(
+                TextBatch::encoded_size(gossip, truncated_texts),
+                [&gossip, &truncated_texts](auto* out) {
+                    TextBatch::encode(gossip, truncated_texts, out);
+                }
+            );
+        }
+
+        auto message = std::allocate_shared<ChatMessage>(
+            std::pmr::polymorphic_allocator<ChatMessage>(&resource),
+            std::move(frame),
+            &resource
+        );
+        message->parse(peer);
+        return message;
+    }
+
+    // Messages are freed from any thread
+    [[nodiscard]] static std::pmr::synchronized_pool_resource& pool() {
+        static std::pmr::synchronized_pool_resource instance;
+        return instance;
+    }
+
+    template<Message M>
+    [[nodiscard]] static WireBuffer encode(const M& msg) {
+        return FramePool::global().make(
+            Codec<M>::encoded_size(msg),
+            [&msg](auto* out) { Codec<M>::encode(msg, out); }
+        );
+    }
+
+    [[nodiscard]] static std::string_view
+    truncated(std::string_view str, std::size_t max_size) {
+        return str.substr(0, std::min(str.size(), max_size));
+    }
+
+    // Points the views into the frame
+    void parse(std::string_view peer) {
+        ByteReader reader(*m_frame);
+        auto packet = Packet::decode(reader);
+        std::string_view origin;
+        packet->match(
+            [this, &origin](TextMessage& msg) {
+                m_id = msg.gossip.id;
+                origin = msg.gossip.origin;
+                m_texts.push_back(msg.text);
+            },
+            [this, &origin](TextBatch& batch) {
+                m_id = batch.gossip.id;
+                origin = batch.gossip.origin;
+                m_texts.reserve(batch.texts.size());
+                m_texts.assign(batch.texts.begin(), batch.texts.end());
+            },
+            [](auto&) {}
+        );
+        if (origin.empty()) {
+            m_peer = peer;
+            origin = m_peer;
+        }
+        m_sender = origin;
+    }
+
+    WireBuffer m_frame;
+    std::uint64_t m_id = 0;
+    std::string_view m_sender;
+    Texts m_texts;
+    // Copy of the sender when the frame has no origin
+    std::pmr::string m_peer;
+};
+
+using ChatMessagePtr = std::shared_ptr<const ChatMessage>;
+
+} // namespace peppe
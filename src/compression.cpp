@@ -0,0 +1,128 @@
+#include "compression.hpp"
+#include "error.hpp"
+
+#include <algorithm>
+
+#if defined(PEPPERONI_WITH_ZSTD)
+#    include <zstd.h>
+#endif
+
+namespace peppe {
+
+#if defined(PEPPERONI_WITH_ZSTD)
+
+namespace {
+
+// Bounds the memory used by each connection on both ends
+constexpr int window_log = 17;
+
+} // namespace
+
+bool compression_supported() { return true; }
+
+StreamCompressor::StreamCompressor(int level) {
+    auto* cctx = ZSTD_createCCtx();
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, window_log);
+    m_context = cctx;
+}
+
+StreamCompressor::~StreamCompressor() {
+    ZSTD_freeCCtx(static_cast<ZSTD_CCtx*>(m_context));
+}
+
+void StreamCompressor::compress(
+    std::span<const std::uint8_t> input,
+    std::vector<std::uint8_t>& out,
+    bool flush
+) {
+    auto* cctx = static_cast<ZSTD_CCtx*>(m_context);
+    const auto mode = flush ? ZSTD_e_flush : ZSTD_e_continue;
+    ZSTD_inBuffer in{ input.data(), input.size(), 0 };
+
+    while (true) {
+        const std::size_t offset = out.size();
+        out.resize(offset + ZSTD_compressBound(in.size - in.pos) + 64);
+        ZSTD_outBuffer dst{ out.data() + offset, out.size() - offset, 0 };
+        const std::size_t remaining =
+            ZSTD_compressStream2(cctx, &dst, &in, mode);
+        out.resize(offset + dst.pos);
+        if (ZSTD_isError(remaining)) {
+            throw ConnectionClosed();
+        }
+        // With ZSTD_e_continue the input is always fully consumed, with
+        // ZSTD_e_flush 'remaining' is the amount left to flush
+        if (in.pos == in.size && (!flush || remaining == 0)) {
+            break;
+        }
+    }
+}
+
+StreamDecompressor::StreamDecompressor() {
+    auto* dctx = ZSTD_createDCtx();
+    ZSTD_DCtx_setParameter(dctx, ZSTD_d_windowLogMax, window_log);
+    m_context = dctx;
+}
+
+StreamDecompressor::~StreamDecompressor() {
+    ZSTD_freeDCtx(static_cast<ZSTD_DCtx*>(m_context));
+}
+
+void StreamDecompressor::decompress(
+    std::span<const std::uint8_t> input,
+    std::vector<std::uint8_t>& out,
+    std::size_t max_size
+) {
+    auto* dctx = static_cast<ZSTD_DCtx*>(m_context);
+    ZSTD_inBuffer in{ input.data(), input.size(), 0 };
+
+    while (true) {
+        const std::size_t offset = out.size();
+        if (offset >= max_size) {
+            throw ConnectionClosed();
+        }
+        out.resize(std::min(offset + ZSTD_DStreamOutSize(), max_size));
+        ZSTD_outBuffer dst{ out.data() + offset, out.size() - offset, 0 };
+        const std::size_t res = ZSTD_decompressStream(dctx, &dst, &in);
+        out.resize(offset + dst.pos);
+        if (ZSTD_isError(res)) {
+            throw ConnectionClosed();
+        }
+        // Everything flushed by the sender has been produced once the input
+        // is consumed and the output buffer wasn't filled
+        if (in.pos == in.size && dst.pos < dst.size) {
+            break;
+        }
+    }
+}
+
+#else
+
+bool compression_supported() { return false; }
+
+StreamCompressor::StreamCompressor(int) {}
+StreamCompressor::~StreamCompressor() = default;
+
+void StreamCompressor::compress(
+    std::span<const std::uint8_t> input,
+    std::vector<std::uint8_t>& out,
+    bool
+) {
+    out.insert(out.end(), input.begin(), input.end());
+}
+
+StreamDecompressor::StreamDecompressor() = default;
+StreamDecompressor::~StreamDecompressor() = default;
+
+void StreamDecompressor::decompress(
+    std::span<const std::uint8_t>,
+    std::vector<std::uint8_t>&,
+    std::size_t
+) {
+    // Compression is never negotiated without support for it
+    throw ConnectionClosed();
+}
+
+#endif
+
+} // namespace peppe
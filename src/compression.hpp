@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace peppe {
+
+struct CompressionConfig {
+    bool enabled = true;
+    // Writes smaller than this are sent uncompressed
+    std::size_t threshold = 256;
+    int level = 3;
+};
+
+struct CompressionStats {
+    // Bytes before and after compression of the compressed writes
+    std::atomic<std::uint64_t> raw_bytes = 0;
+    std::atomic<std::uint64_t> compressed_bytes = 0;
+    std::atomic<std::uint64_t> compressed_writes = 0;
+    // Writes sent as is because they were below the threshold
+    std::atomic<std::uint64_t> skipped_writes = 0;
+    std::atomic<std::uint64_t> compress_ns = 0;
+    std::atomic<std::uint64_t> decompress_ns = 0;
+
+    [[nodiscard]] double ratio() const {
+        const auto raw = raw_bytes.load(std::memory_order_relaxed);
+        const auto compressed =
+            compressed_bytes.load(std::memory_order_relaxed);
+        return (compressed == 0) ? 1.0 : double(raw) / double(compressed);
+    }
+};
+
+// Whether the binary was built with compression support
+[[nodiscard]] bool compression_supported();
+
+// Streaming compressor of a connection. Successive calls share the same
+// window, so repeated content across frames (names, addresses...) is
+// compressed against previous frames.
+class StreamCompressor {
+public:
+    // Ctor
+    explicit StreamCompressor(int level);
+    // Copy
+    StreamCompressor(StreamCompressor const&) = delete;
+    StreamCompressor& operator=(StreamCompressor const&) = delete;
+    // Move
+    StreamCompressor(StreamCompressor&&) = delete;
+    StreamCompressor& operator=(StreamCompressor&&) = delete;
+    // Dtor
+    ~StreamCompressor();
+
+    // Appends the compressed 'input' to 'out'. With 'flush' the peer can
+    // decompress everything written so far.
+    void compress(
+        std::span<const std::uint8_t> input,
+        std::vector<std::uint8_t>& out,
+        bool flush
+    );
+
+private:
+    void* m_context = nullptr;
+};
+
+class StreamDecompressor {
+public:
+    // Ctor
+    StreamDecompressor();
+    // Copy
+    StreamDecompressor(StreamDecompressor const&) = delete;
+    StreamDecompressor& operator=(StreamDecompressor const&) = delete;
+    // Move
+    StreamDecompressor(StreamDecompressor&&) = delete;
+    StreamDecompressor& operator=(StreamDecompressor&&) = delete;
+    // Dtor
+    ~StreamDecompressor();
+
+    // Appends the decompressed 'input' to 'out', which can't grow past
+    // 'max_size'. Throws ConnectionClosed on corrupted input.
+    void decompress(
+        std::span<const std::uint8_t> input,
+        std::vector<std::uint8_t>& out,
+        std::size_t max_size
+    );
+
+private:
+    void* m_context = nullptr;
+};
+
+} // namespace peppe
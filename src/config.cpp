@@ -29,51 +29,273 @@ std::optional<Config> Config::load_toml(std::string_view filename) {
         result.port = *port_opt;
     }
 
+    // Load worker thread count
+    const auto threads_opt = toml["threads"].value<std::int64_t>();
+    if (threads_opt.has_value() && *threads_opt >= 0) {
+        result.threads = unsigned(*threads_opt);
+    }
+
+    // Load outbound queue settings
+    const auto high_watermark_opt =
+        toml["outbound_high_watermark"].value<std::int64_t>();
+    if (high_watermark_opt.has_value() && *high_watermark_opt > 0) {
+        result.outbound.high_watermark = std::size_t(*high_watermark_opt);
+    }
+    const auto low_watermark_opt =
+        toml["outbound_low_watermark"].value<std::int64_t>();
+    if (low_watermark_opt.has_value() && *low_watermark_opt >= 0) {
+        result.outbound.low_watermark = std::size_t(*low_watermark_opt);
+    }
+    if (result.outbound.low_watermark > result.outbound.high_watermark) {
+        fmt::print(
+            stderr, "outbound_low_watermark is above the high watermark\n"
+        );
+        result.outbound.low_watermark = result.outbound.high_watermark;
+    }
+    const auto policy_opt =
+        toml["outbound_overflow_policy"].value<std::string>();
+    if (policy_opt.has_value()) {
+        const auto policy = overflow_policy_from_string(*policy_opt);
+        if (policy.has_value()) {
+            result.outbound.policy = *policy;
+        }
+        else {
+            fmt::print(
+                stderr, "Unknown outbound_overflow_policy '{}'\n", *policy_opt
+            );
+        }
+    }
+    const auto fragment_size_opt =
+        toml["outbound_fragment_size"].value<std::int64_t>();
+    if (fragment_size_opt.has_value() && *fragment_size_opt >= 0) {
+        result.outbound.fragment_size = std::size_t(*fragment_size_opt);
+    }
+
+    // Load text batching settings
+    const auto flush_window_opt =
+        toml["batch_flush_window_us"].value<std::int64_t>();
+    if (flush_window_opt.has_value() && *flush_window_opt >= 0) {
+        result.batch.flush_window =
+            std::chrono::microseconds(*flush_window_opt);
+    }
+    const auto batch_bytes_opt = toml["batch_max_bytes"].value<std::int64_t>();
+    if (batch_bytes_opt.has_value() && *batch_bytes_opt > 0) {
+        result.batch.max_bytes = std::size_t(*batch_bytes_opt);
+    }
+
+    // Load compression settings
+    const auto compression_opt = toml["compression"].value<bool>();
+    if (compression_opt.has_value()) {
+        result.compression.enabled = *compression_opt;
+    }
+    const auto threshold_opt =
+        toml["compression_threshold"].value<std::int64_t>();
+    if (threshold_opt.has_value() && *threshold_opt >= 0) {
+        result.compression.threshold = std::size_t(*threshold_opt);
+    }
+    const auto level_opt = toml["compression_level"].value<int>();
+    if (level_opt.has_value()) {
+        result.compression.level = *level_opt;
+    }
+
+    // Load gossip settings
+    const auto fanout_opt = toml["gossip_fanout"].value<std::int64_t>();
+    if (fanout_opt.has_value() && *fanout_opt >= 0) {
+        result.gossip.fanout = std::size_t(*fanout_opt);
+    }
+    const auto ttl_opt = toml["gossip_ttl"].value<std::int64_t>();
+    if (ttl_opt.has_value()) {
+        result.gossip.ttl = std::uint8_t(std::clamp<std::int64_t>(
+            *ttl_opt, 1, std::numeric_limits<std::uint8_t>::max()
+        ));
+    }
+    const auto cache_size_opt =
+        toml["gossip_cache_size"].value<std::int64_t>();
+    if (cache_size_opt.has_value() && *cache_size_opt > 0) {
+        result.gossip.cache_size = std::size_t(*cache_size_opt);
+    }
+
+    // Load dial settings
+    const auto connect_timeout_opt =
+        toml["connect_timeout_ms"].value<std::int64_t>();
+    if (connect_timeout_opt.has_value() && *connect_timeout_opt > 0) {
+        result.dial.connect_timeout =
+            std::chrono::milliseconds(*connect_timeout_opt);
+    }
+    const auto max_dials_opt =
+        toml["max_concurrent_dials"].value<std::int64_t>();
+    if (max_dials_opt.has_value() && *max_dials_opt > 0) {
+        result.dial.max_concurrent = std::size_t(*max_dials_opt);
+    }
+    const auto attempt_delay_opt =
+        toml["connect_attempt_delay_ms"].value<std::int64_t>();
+    if (attempt_delay_opt.has_value() && *attempt_delay_opt >= 0) {
+        result.dial.attempt_delay =
+            std::chrono::milliseconds(*attempt_delay_opt);
+    }
+
+    // Load LAN discovery settings
+    const auto discovery_opt = toml["discovery"].value<bool>();
+    if (discovery_opt.has_value()) {
+        result.discovery.enabled = *discovery_opt;
+    }
+    const auto group_opt = toml["discovery_group"].value<std::string>();
+    if (group_opt.has_value()) {
+        asio::error_code err;
+        const auto group = asio::ip::make_address(*group_opt, err);
+        if (err || !group.is_multicast()) {
+            fmt::print(stderr, "Invalid multicast group: {}\n", *group_opt);
+        }
+        else {
+            result.discovery.group = group;
+        }
+    }
+    const auto discovery_port_opt = toml["discovery_port"].value<int>();
+    if (discovery_port_opt.has_value()) {
+        result.discovery.port = asio::ip::port_type(*discovery_port_opt);
+    }
+    const auto interface_opt =
+        toml["discovery_interface"].value<std::string>();
+    if (interface_opt.has_value()) {
+        asio::error_code err;
+        const auto interface = asio::ip::make_address(*interface_opt, err);
+        if (err) {
+            fmt::print(stderr, "Invalid interface: {}\n", *interface_opt);
+        }
+        else {
+            result.discovery.interface = interface;
+        }
+    }
+    const auto announce_interval_opt =
+        toml["discovery_interval_ms"].value<std::int64_t>();
+    if (announce_interval_opt.has_value() && *announce_interval_opt > 0) {
+        result.discovery.interval =
+            std::chrono::milliseconds(*announce_interval_opt);
+    }
+
+    // Load heartbeat settings
+    const auto heartbeat_interval_opt =
+        toml["heartbeat_interval_ms"].value<std::int64_t>();
+    if (heartbeat_interval_opt.has_value() && *heartbeat_interval_opt >= 0) {
+        result.heartbeat.interval =
+            std::chrono::milliseconds(*heartbeat_interval_opt);
+    }
+    const auto max_missed_opt =
+        toml["heartbeat_max_missed"].value<std::int64_t>();
+    if (max_missed_opt.has_value() && *max_missed_opt > 0) {
+        result.heartbeat.max_missed = std::size_t(*max_missed_opt);
+    }
+
+    // Load file transfer settings
+    auto download_dir_opt = toml["download_dir"].value<std::string>();
+    if (download_dir_opt.has_value()) {
+        result.files.download_dir = std::move(*download_dir_opt);
+    }
+    const auto max_file_size_opt =
+        toml["max_file_size"].value<std::int64_t>();
+    if (max_file_size_opt.has_value() && *max_file_size_opt >= 0) {
+        result.files.max_file_size = std::uint64_t(*max_file_size_opt);
+    }
+    const auto chunk_size_opt = toml["file_chunk_size"].value<std::int64_t>();
+    if (chunk_size_opt.has_value() && *chunk_size_opt > 0) {
+        result.files.chunk_size = std::size_t(std::min<std::int64_t>(
+            *chunk_size_opt, FileTransferConfig::max_chunk_size
+        ));
+    }
+    const auto window_opt = toml["file_window"].value<std::int64_t>();
+    if (window_opt.has_value() && *window_opt > 0) {
+        result.files.window = std::size_t(std::min<std::int64_t>(
+            *window_opt, FileTransferConfig::max_chunk_size
+        ));
+    }
+
+    // Load metrics endpoint port
+    const auto metrics_port_opt = toml["metrics_port"].value<int>();
+    if (metrics_port_opt.has_value()) {
+        result.metrics_port = *metrics_port_opt;
+    }
+
+    // Load peer Unix domain socket path
+    auto unix_socket_opt = toml["unix_socket"].value<std::string>();
+    if (unix_socket_opt.has_value()) {
+        result.unix_socket = std::move(*unix_socket_opt);
+    }
+
+    // Load control socket path
+    auto control_socket_opt = toml["control_socket"].value<std::string>();
+    if (control_socket_opt.has_value()) {
+        result.control_socket = std::move(*control_socket_opt);
+    }
+
+    // Load message history settings
+    auto history_dir_opt = toml["history_dir"].value<std::string>();
+    if (history_dir_opt.has_value()) {
+        result.history.directory = std::move(*history_dir_opt);
+    }
+    const auto segment_size_opt =
+        toml["history_segment_size"].value<std::int64_t>();
+    if (segment_size_opt.has_value() && *segment_size_opt > 0) {
+        result.history.segment_size = std::size_t(*segment_size_opt);
+    }
+
+    // Load logger settings
+    auto log_file_opt = toml["log_file"].value<std::string>();
+    if (log_file_opt.has_value()) {
+        result.logger.file = std::move(*log_file_opt);
+    }
+
     // Load peers
     if (toml::array* peers_arr = toml["peers"].as_array()) {
         peers_arr->for_each([&result](auto&& peer_str) {
             if constexpr (toml::is_string<decltype(peer_str)>) {
+                const std::string_view peer = *peer_str;
 
-                // Split ip string and then parse contents
-                const auto splitted = split(*peer_str, ':');
-                if (splitted.size() == 2) {
-
-                    // Parse peer ip address
-                    asio::error_code ec;
-                    asio::ip::address peer_address =
-                        asio::ip::address::from_string(
-                            std::string(splitted[0]), ec
-                        );
-                    if (ec) {
-                        fmt::print(
-                            stderr,
-                            "Failed parsing peer ip address: {}",
-                            splitted[0]
-                        );
+                // Peer on the same host, as "unix:/path/to/socket"
+                constexpr std::string_view local_prefix = "unix:";
+                if (peer.starts_with(local_prefix)) {
+                    const auto path = peer.substr(local_prefix.size());
+                    if (path.empty()) {
+                        fmt::print(stderr, "Missing socket path: {}\n", peer);
                         return;
                     }
-
-                    // Parse peer port
-                    int peer_port = -1;
-                    auto parse_port_result = std::from_chars(
-                        splitted[1].data(),
-                        splitted[1].data() + splitted[1].size(),
-                        peer_port
+                    result.peer_table.push_back(
+                        Peer{ .local_path = std::string(path) }
                     );
-                    if (parse_port_result.ec != std::errc{}) {
-                        fmt::print(
-                            stderr, "Failed parsing peer port: {}", splitted[1]
-                        );
-                        return;
-                    }
+                    return;
+                }
 
-                    // Emplace peer
-                    result.peer_table.push_back(Peer{
-                        // FIXME: Unecessary allocation
-                        .address = std::move(peer_address),
-                        .port = peer_port,
-                    });
+                // Split at the last ':', IPv6 addresses are bracketed
+                const auto separator = peer.rfind(':');
+                if (separator == std::string_view::npos) {
+                    fmt::print(stderr, "Missing peer port: {}\n", peer);
+                    return;
+                }
+                auto host = peer.substr(0, separator);
+                const auto port = peer.substr(separator + 1);
+                if (host.size() >= 2 && host.front() == '[' &&
+                    host.back() == ']') {
+                    host = host.substr(1, host.size() - 2);
+                }
+                if (host.empty()) {
+                    fmt::print(stderr, "Missing peer host: {}\n", peer);
+                    return;
                 }
+
+                // Parse peer port
+                int peer_port = -1;
+                auto parse_port_result = std::from_chars(
+                    port.data(), port.data() + port.size(), peer_port
+                );
+                if (parse_port_result.ec != std::errc{}) {
+                    fmt::print(stderr, "Failed parsing peer port: {}\n", port);
+                    return;
+                }
+
+                // Emplace peer, host names are resolved when dialing
+                result.peer_table.push_back(Peer{
+                    .host = std::string(host),
+                    .port = peer_port,
+                });
             }
         });
     }
@@ -1,6 +1,15 @@
 #pragma once
 
+#include "compression.hpp"
+#include "discovery.hpp"
+#include "file_transfer.hpp"
+#include "gossip.hpp"
+#include "heartbeat.hpp"
+#include "logger.hpp"
+#include "message_log.hpp"
+#include "outbound_queue.hpp"
 #include "peer_table.hpp"
+#include "text_batcher.hpp"
 #include "utils.hpp"
 
 #include <charconv>
@@ -16,7 +25,25 @@ constexpr int default_port = 2504;
 struct Config {
     std::string name = "Me";
     int port = default_port;
+    // Unix domain socket accepting peers on the same host (empty = disabled)
+    std::string unix_socket;
+    // Number of threads running the network event loop (0 = one per core)
+    unsigned threads = 0;
     PeerTable peer_table;
+    OutboundConfig outbound;
+    HistoryConfig history;
+    LoggerConfig logger;
+    BatchConfig batch;
+    CompressionConfig compression;
+    GossipConfig gossip;
+    DialConfig dial;
+    DiscoveryConfig discovery;
+    HeartbeatConfig heartbeat;
+    FileTransferConfig files;
+    // Loopback port of the Prometheus metrics endpoint (0 = disabled)
+    int metrics_port = 0;
+    // Unix domain socket of the control API (empty = disabled)
+    std::string control_socket;
 
     [[nodiscard]] static std::optional<Config> load_toml(
         std::string_view filename
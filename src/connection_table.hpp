@@ -32,16 +32,27 @@ using namespace std::literals::chrono_literals;
 // #    def ine use_awaitable \
 //        asio::use_awaitable_t(__FILE__, __LINE__, __PRETTY_FUNCTION__)
 // #endif
+#include "compression.hpp"
+#include "file_transfer.hpp"
+#include "frame_reader.hpp"
+#include "gossip.hpp"
+#include "logger.hpp"
 #include "message.hpp"
+#include "metrics.hpp"
+#include "outbound_queue.hpp"
+#include "slot_map.hpp"
 
 #include <list>
+#include <mutex>
 #include <optional>
+#include <random>
+#include <shared_mutex>
 #include <string>
 
 using namespace asio;
 using namespace peppe;
 
-awaitable<void> timeout(steady_clock::duration duration) {
+inline awaitable<void> timeout(steady_clock::duration duration) {
     asio::steady_timer timer(co_await this_coro::executor);
     timer.expires_after(duration);
     co_await timer.async_wait(use_nothrow_awaitable);
@@ -50,41 +61,230 @@ awaitable<void> timeout(steady_clock::duration duration) {
 
 using asio::ip::tcp;
 
+// Transport independent state of a connection, the socket is owned by the
+// session
 struct PeerConnection {
+    PeerConnection(Strand strand, const OutboundConfig& outbound_config)
+        : outbound(std::move(strand), outbound_config) {}
+
+    std::optional<std::string> name;
+    OutboundQueue outbound;
+    ReceiveStats inbound;
+    CompressionStats compression;
+    OutgoingTransfers files;
+};
+
+using ConnectionHandle = SlotHandle;
+
+// Cached when the peer connects, no socket call is needed to read it
+struct PeerInfo {
+    // "address:port", or "unix:path" for a peer on the same host
+    std::string address;
+    // Not set for Unix domain socket peers
+    std::optional<asio::ip::address> ip;
     std::optional<std::string> name;
-    tcp::socket socket;
+    // Smoothed round trip time, once a heartbeat was answered
+    std::optional<std::chrono::microseconds> rtt;
 };
 
+// Shared by every session and the frontend thread, all accesses are
+// synchronized. Broadcasts only take a shared lock.
+// Connections are stored contiguously in a slot map, sessions refer to
+// their entry by handle. A handle outliving its connection is detected.
 class ConnectionTable {
 public:
+    static constexpr std::size_t max_known_nodes = 4096;
+
     // Ctor
     ConnectionTable() = default;
     // Dtor
     ~ConnectionTable() = default;
 
-    std::ranges::view auto connected_peers() {
-        return std::views::transform(
-            m_connection_table,
-            [](PeerConnection* conn) -> asio::ip::address {
-                return conn->socket.remote_endpoint().address();
+    [[nodiscard]] std::vector<asio::ip::address> connected_peers() const {
+        std::shared_lock lock(m_mutex);
+        std::vector<asio::ip::address> result;
+        result.reserve(m_connections.size());
+        for (const auto& entry : m_connections.values()) {
+            if (entry.info.ip.has_value()) {
+                result.push_back(*entry.info.ip);
             }
-        );
+        }
+        return result;
+    }
+
+    [[nodiscard]] std::vector<PeerInfo> peers() const {
+        std::shared_lock lock(m_mutex);
+        std::vector<PeerInfo> result;
+        result.reserve(m_connections.size());
+        for (const auto& entry : m_connections.values()) {
+            result.push_back(entry.info);
+        }
+        return result;
+    }
+
+    // std::nullopt once the peer disconnected
+    [[nodiscard]] std::optional<PeerInfo> info(ConnectionHandle handle) const {
+        std::shared_lock lock(m_mutex);
+        const auto* entry = m_connections.get(handle);
+        if (entry == nullptr) {
+            return std::nullopt;
+        }
+        return entry->info;
+    }
+
+    void set_name(ConnectionHandle handle, const std::string& name) {
+        std::unique_lock lock(m_mutex);
+        if (auto* entry = m_connections.get(handle)) {
+            entry->info.name = name;
+        }
+    }
+
+    // Display names are chosen by the peer, reconnects are counted on its
+    // node id instead
+    void set_node_id(ConnectionHandle handle, std::uint64_t node_id) {
+        std::unique_lock lock(m_mutex);
+        if (m_connections.get(handle) != nullptr &&
+            !m_known_nodes.insert(node_id)) {
+            Metrics::global().reconnects.add();
+        }
+    }
+
+    void set_rtt(ConnectionHandle handle, std::chrono::microseconds rtt) {
+        std::unique_lock lock(m_mutex);
+        if (auto* entry = m_connections.get(handle)) {
+            entry->info.rtt = rtt;
+        }
     }
 
-    void remove(PeerConnection* conn) {
-        std::ranges::remove_if(m_connection_table, [&conn](auto c) {
-            return conn->socket.local_endpoint() == c->socket.local_endpoint();
-        });
+    void remove(ConnectionHandle handle) {
+        std::unique_lock lock(m_mutex);
+        if (m_connections.erase(handle)) {
+            Metrics::global().connections_closed.add();
+        }
     }
 
-    void add(PeerConnection* conn) { m_connection_table.push_back(conn); }
+    ConnectionHandle add(PeerConnection* conn, PeerInfo info) {
+        std::unique_lock lock(m_mutex);
+        Metrics::global().connections_opened.add();
+        return m_connections.emplace(
+            Entry{ .connection = conn, .info = std::move(info) }
+        );
+    }
 
+    // Queues the packet on every connection. Never blocks on a socket, the
+    // frames are written by each session's writer coroutine.
     void send_all(const Packet& packet) const {
-        for (auto* conn : m_connection_table) {
-            packet.write(conn->socket);
+        send_all(packet.encode_shared());
+    }
+
+    // The same encoded bytes are shared by every recipient
+    void send_all(const WireBuffer& frame) const {
+        std::shared_lock lock(m_mutex);
+        for (const auto& entry : m_connections.values()) {
+            const auto result =
+                entry.connection->outbound.push(WireBuffer(frame));
+            if (result == OutboundQueue::PushResult::Disconnect) {
+                log_warn("Peer fell behind, disconnecting");
+            }
+        }
+    }
+
+    // Queues the frame on up to 'count' random connections other than
+    // 'exclude'. Returns the number of connections it was queued on.
+    std::size_t send_sample(
+        const WireBuffer& frame,
+        ConnectionHandle exclude,
+        std::size_t count
+    ) const {
+        thread_local std::minstd_rand rng{ std::random_device{}() };
+        std::shared_lock lock(m_mutex);
+        const auto* excluded = m_connections.get(exclude);
+        // Selection sampling over the candidates
+        std::size_t candidates =
+            m_connections.size() - ((excluded != nullptr) ? 1 : 0);
+        std::size_t sent = 0;
+        for (const auto& entry : m_connections.values()) {
+            if (sent == count || candidates == 0) {
+                break;
+            }
+            if (&entry == excluded) {
+                continue;
+            }
+            const auto needed = count - sent;
+            if (std::uniform_int_distribution<std::size_t>(
+                    0, candidates - 1
+                )(rng) < needed) {
+                entry.connection->outbound.push(WireBuffer(frame));
+                ++sent;
+            }
+            --candidates;
         }
+        return sent;
+    }
+
+    // Offers the file on every connection it isn't already offered on.
+    // Returns the number of peers it was offered to.
+    std::size_t offer_file(const std::shared_ptr<FileSource>& source) const {
+        auto name = source->name();
+        const auto offer =
+            Packet::file_offer(source->id(), source->size(), std::move(name))
+                .encode_shared();
+        std::shared_lock lock(m_mutex);
+        std::size_t offered = 0;
+        for (const auto& entry : m_connections.values()) {
+            if (entry.connection->files.offer(source)) {
+                entry.connection->outbound.push(WireBuffer(offer));
+                ++offered;
+            }
+        }
+        return offered;
+    }
+
+    [[nodiscard]] std::vector<OutboundStats> outbound_stats() const {
+        std::shared_lock lock(m_mutex);
+        std::vector<OutboundStats> result;
+        result.reserve(m_connections.size());
+        for (const auto& entry : m_connections.values()) {
+            result.push_back(entry.connection->outbound.stats());
+        }
+        return result;
+    }
+
+    // Snapshot of every connection's counters
+    [[nodiscard]] std::vector<PeerMetrics> peer_metrics() const {
+        std::shared_lock lock(m_mutex);
+        std::vector<PeerMetrics> result;
+        result.reserve(m_connections.size());
+        for (const auto& entry : m_connections.values()) {
+            const auto& conn = *entry.connection;
+            const auto outbound = conn.outbound.stats();
+            result.push_back(PeerMetrics{
+                .peer = entry.info.address,
+                .name = entry.info.name,
+                .reads = conn.inbound.reads.load(std::memory_order_relaxed),
+                .frames_received =
+                    conn.inbound.frames.load(std::memory_order_relaxed),
+                .bytes_received =
+                    conn.inbound.bytes.load(std::memory_order_relaxed),
+                .frames_sent = outbound.frames_sent,
+                .bytes_sent = outbound.bytes_sent,
+                .frames_dropped = outbound.frames_dropped,
+                .queue_frames = outbound.depth_frames,
+                .queue_bytes = outbound.depth_bytes,
+                .rtt = entry.info.rtt,
+            });
+        }
+        return result;
     }
 
 private:
-    std::vector<PeerConnection*> m_connection_table;
+    struct Entry {
+        PeerConnection* connection = nullptr;
+        PeerInfo info;
+    };
+
+    mutable std::shared_mutex m_mutex;
+    SlotMap<Entry> m_connections;
+    // Node ids of the last peers seen, to count reconnects
+    DuplicateFilter m_known_nodes{ max_known_nodes };
 };
\ No newline at end of file
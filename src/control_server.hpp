@@ -0,0 +1,374 @@
+#pragma once
+
+#include "chat_message.hpp"
+#include "connection_table.hpp"
+#include "events.hpp"
+#include "local_socket.hpp"
+#include "logger.hpp"
+#include "outbound_queue.hpp"
+#include "text_batcher.hpp"
+
+#include <asio/local/stream_protocol.hpp>
+#include <asio/read_until.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/strand.hpp>
+#include <asio/write.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace peppe {
+
+// Local API of a node, served on a Unix domain socket. Requests and replies
+// are newline terminated lines, reply fields are separated by tabs:
+//
+//   send <text>   ->  ok
+//   sendfile <path>  ->  ok <peers the file was offered to>
+//   peers         ->  peer <address> <name> <rtt_us>  (one per peer)
+//                     end
+//   subscribe     ->  ok
+//                     msg <from> <text>  (for every message received)
+//                     file <from> <path>  (for every file received)
+//
+// Line breaks, tabs and backslashes in texts are escaped as \n, \t and \\.
+// A subscriber that can't keep up loses its oldest lines, it never slows
+// the network threads down.
+class ControlServer : public EventListener<ControlServer, BackendEvent> {
+public:
+    using Protocol = asio::local::stream_protocol;
+
+    // Ctor
+    ControlServer(
+        asio::io_context& io_context,
+        const ConnectionTable& table,
+        TextBatcher& batcher
+    )
+        : m_io_context(io_context)
+        , m_connection_table_ref(table)
+        , m_batcher_ref(batcher) {}
+    // Copy
+    ControlServer(ControlServer const&) = delete;
+    ControlServer& operator=(ControlServer const&) = delete;
+    // Move
+    ControlServer(ControlServer&&) = delete;
+    ControlServer& operator=(ControlServer&&) = delete;
+    // Dtor
+    ~ControlServer() {
+        if (!m_path.empty()) {
+            std::error_code ignored;
+            std::filesystem::remove(m_path, ignored);
+        }
+    }
+
+    awaitable<void> listen(std::string path) {
+        if (!remove_stale_socket(path)) {
+            log_error("Control socket disabled");
+            co_return;
+        }
+        Protocol::acceptor acceptor(m_io_context);
+        acceptor.open();
+        asio::error_code err;
+        acceptor.bind(Protocol::endpoint(path), err);
+        if (err) {
+            log_error("Failed binding '{}': {}", path, err.message());
+            co_return;
+        }
+        m_path = std::move(path);
+        // Only the user running the node may connect. Connections are
+        // refused until listen(), so nobody gets in before the chmod.
+        if (::chmod(m_path.c_str(), 0600) != 0) {
+            log_error(
+                "Failed restricting access to '{}': {}",
+                m_path,
+                std::strerror(errno)
+            );
+            co_return;
+        }
+        acceptor.listen();
+        log_info("Control socket listening on '{}'", m_path);
+
+        asio::steady_timer backoff(m_io_context);
+        while (true) {
+            auto [err, socket] = co_await acceptor.async_accept(
+                asio::make_strand(m_io_context), use_nothrow_awaitable
+            );
+            if (err == asio::error::operation_aborted) {
+                co_return;
+            }
+            if (err) {
+                // Out of file descriptors, most likely: retrying at once
+                // would spin until one is released
+                log_warn(
+                    "Failed accepting a control client: {}", err.message()
+                );
+                backoff.expires_after(accept_backoff);
+                co_await backoff.async_wait(use_nothrow_awaitable);
+                continue;
+            }
+            auto client = std::make_shared<Client>(std::move(socket));
+            const auto executor = client->socket.get_executor();
+            co_spawn(
+                executor,
+                [this, client] { return reader(client); },
+                detached
+            );
+            co_spawn(executor, [client] { return writer(client); }, detached);
+        }
+    }
+
+    // Called from the network threads. The line is formatted once and
+    // shared by every subscriber.
+    void on_event(const BackendEvent& event) override {
+        if (m_subscriber_count.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+
+        std::string lines;
+        event.match(
+            [&lines](const ReceiveMessage& received) {
+                const auto& message = *received.message;
+                for (const auto text : message.texts()) {
+                    append_msg_line(lines, message.sender(), text);
+                }
+            },
+            [&lines](const ReceiveFile& file) {
+                lines += fmt::format(
+                    "file\t{}\t{}\n", escape(file.from), escape(file.path)
+                );
+            },
+            [](const auto&) {}
+        );
+        if (lines.empty()) {
+            return;
+        }
+
+        const auto frame = to_frame(lines);
+        std::shared_lock lock(m_mutex);
+        for (const auto& subscriber : m_subscribers) {
+            subscriber->outbound.push(
+                WireBuffer(frame), FramePriority::Interactive
+            );
+        }
+    }
+
+private:
+    static constexpr std::size_t max_line_size = 64 * 1024;
+    // Delay before accepting again after a failed accept
+    static constexpr auto accept_backoff = std::chrono::milliseconds(100);
+
+    struct Client {
+        explicit Client(StrandSocket<Protocol>&& sock)
+            : socket(std::move(sock))
+            , outbound(socket.get_executor(), OutboundConfig{}) {}
+
+        StrandSocket<Protocol> socket;
+        OutboundQueue outbound;
+        bool subscribed = false;
+    };
+
+    awaitable<void> reader(std::shared_ptr<Client> client) {
+        std::string buffer;
+        while (true) {
+            auto [err, len] = co_await asio::async_read_until(
+                client->socket,
+                asio::dynamic_buffer(buffer, max_line_size),
+                '\n',
+                use_nothrow_awaitable
+            );
+            if (err) {
+                break;
+            }
+            auto line = std::string_view(buffer).substr(0, len - 1);
+            if (line.ends_with('\r')) {
+                line.remove_suffix(1);
+            }
+            handle(client, line);
+            buffer.erase(0, len);
+        }
+
+        if (client->subscribed) {
+            std::unique_lock lock(m_mutex);
+            std::erase(m_subscribers, client);
+            m_subscriber_count.fetch_sub(1, std::memory_order_release);
+        }
+        client->outbound.close();
+    }
+
+    static awaitable<void> writer(std::shared_ptr<Client> client) {
+        // Lines are never fragmented, fragments are only enabled by peers
+        std::vector<OutboundQueue::Slice> slices;
+        std::vector<asio::const_buffer> buffers;
+        while (true) {
+            const auto result = client->outbound.pop_batch(slices);
+            if (result == OutboundQueue::PopResult::Closed) {
+                break;
+            }
+            if (result == OutboundQueue::PopResult::Empty) {
+                co_await client->outbound.async_wait(use_nothrow_awaitable);
+                continue;
+            }
+            buffers.clear();
+            for (const auto& slice : slices) {
+                const auto bytes = slice.bytes();
+                buffers.emplace_back(bytes.data(), bytes.size());
+            }
+            auto [err, len] = co_await asio::async_write(
+                client->socket, buffers, use_nothrow_awaitable
+            );
+            slices.clear();
+            if (err) {
+                break;
+            }
+            client->outbound.record_sent(len);
+        }
+        // Unblock the reader
+        client->outbound.close();
+        asio::error_code ignored;
+        client->socket.shutdown(Protocol::socket::shutdown_both, ignored);
+        client->socket.close(ignored);
+    }
+
+    void handle(const std::shared_ptr<Client>& client, std::string_view line) {
+        const auto space = line.find(' ');
+        const auto command = line.substr(0, space);
+        const auto argument = (space == std::string_view::npos)
+                                  ? std::string_view()
+                                  : line.substr(space + 1);
+
+        std::string reply;
+        if (command == "send") {
+            m_batcher_ref.push(unescape(argument));
+            reply = "ok\n";
+        }
+        else if (command == "sendfile") {
+            const auto source = FileSource::open(unescape(argument));
+            if (source == nullptr) {
+                reply = "error\tcan't read the file\n";
+            }
+            else {
+                reply = fmt::format(
+                    "ok\t{}\n", m_connection_table_ref.offer_file(source)
+                );
+            }
+        }
+        else if (command == "peers") {
+            for (const auto& peer : m_connection_table_ref.peers()) {
+                reply += fmt::format(
+                    "peer\t{}\t{}\t{}\n",
+                    escape(peer.address),
+                    escape(peer.name.value_or("")),
+                    peer.rtt.has_value() ? peer.rtt->count() : -1
+                );
+            }
+            reply += "end\n";
+        }
+        else if (command == "subscribe") {
+            // Acknowledged before the first message line
+            client->outbound.push(to_frame("ok\n"), FramePriority::Control);
+            if (!client->subscribed) {
+                client->subscribed = true;
+                std::unique_lock lock(m_mutex);
+                m_subscribers.push_back(client);
+                m_subscriber_count.fetch_add(1, std::memory_order_release);
+            }
+            return;
+        }
+        else {
+            reply =
+                fmt::format("error\tunknown command '{}'\n", escape(command));
+        }
+        client->outbound.push(to_frame(reply), FramePriority::Control);
+    }
+
+    static void append_msg_line(
+        std::string& lines,
+        std::string_view from,
+        std::string_view text
+    ) {
+        lines += "msg\t";
+        lines += escape(from);
+        lines += '\t';
+        lines += escape(text);
+        lines += '\n';
+    }
+
+    [[nodiscard]] static std::string escape(std::string_view text) {
+        std::string result;
+        result.reserve(text.size());
+        for (const char c : text) {
+            switch (c) {
+                case '\\': {
+                    result += "\\\\";
+                    break;
+                }
+                case '\n': {
+                    result += "\\n";
+                    break;
+                }
+                case '\t': {
+                    result += "\\t";
+                    break;
+                }
+                default: {
+                    result += c;
+                    break;
+                }
+            }
+        }
+        return result;
+    }
+
+    [[nodiscard]] static std::string unescape(std::string_view text) {
+        std::string result;
+        result.reserve(text.size());
+        for (std::size_t i = 0; i < text.size(); ++i) {
+            if (text[i] != '\\' || i + 1 == text.size()) {
+                result += text[i];
+                continue;
+            }
+            switch (text[++i]) {
+                case 'n': {
+                    result += '\n';
+                    break;
+                }
+                case 't': {
+                    result += '\t';
+                    break;
+                }
+                default: {
+                    result += text[i];
+                    break;
+                }
+            }
+        }
+        return result;
+    }
+
+    [[nodiscard]] static WireBuffer to_frame(std::string_view text) {
+        return FramePool::global().make(text.size(), [text](auto* out) {
+            std::ranges::copy(text, out);
+        });
+    }
+
+    asio::io_context& m_io_context;
+    const ConnectionTable& m_connection_table_ref;
+    TextBatcher& m_batcher_ref;
+    std::string m_path;
+    mutable std::shared_mutex m_mutex;
+    std::vector<std::shared_ptr<Client>> m_subscribers;
+    std::atomic<std::size_t> m_subscriber_count = 0;
+};
+
+} // namespace peppe
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "connection_table.hpp"
+#include "logger.hpp"
+#include "peer_table.hpp"
+
+#include <asio/experimental/awaitable_operators.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/local/stream_protocol.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace peppe {
+
+namespace detail {
+
+// Attempts of a single dial, only accessed from the dial's strand
+struct DialRace {
+    explicit DialRace(const asio::any_io_executor& executor)
+        : wakeup(executor) {}
+
+    std::optional<StrandSocket<tcp>> winner;
+    std::vector<std::shared_ptr<StrandSocket<tcp>>> attempts;
+    std::size_t running = 0;
+    // Cancelled whenever an attempt completes
+    asio::steady_timer wakeup;
+
+    awaitable<void> wait_until(steady_clock::time_point deadline) {
+        wakeup.expires_at(deadline);
+        co_await wakeup.async_wait(use_nothrow_awaitable);
+    }
+};
+
+inline awaitable<void> dial_attempt(
+    std::shared_ptr<DialRace> race,
+    std::shared_ptr<StrandSocket<tcp>> socket,
+    tcp::endpoint endpoint,
+    steady_clock::duration deadline
+) {
+    using namespace asio::experimental::awaitable_operators;
+    auto result = co_await (
+        socket->async_connect(endpoint, use_nothrow_awaitable) ||
+        timeout(deadline)
+    );
+
+    // The other attempts are closed once a winner is found
+    const bool connected =
+        result.index() == 0 && !std::get<0>(std::get<0>(result));
+    if (connected && !race->winner.has_value()) {
+        race->winner.emplace(std::move(*socket));
+    }
+    --race->running;
+    race->wakeup.cancel();
+}
+
+// Orders the addresses of a host, alternating families and starting with
+// IPv6 (RFC 8305)
+inline std::vector<tcp::endpoint> interleave_families(
+    const tcp::resolver::results_type& results
+) {
+    std::vector<tcp::endpoint> v6;
+    std::vector<tcp::endpoint> v4;
+    for (const auto& entry : results) {
+        auto& family = entry.endpoint().address().is_v6() ? v6 : v4;
+        family.push_back(entry.endpoint());
+    }
+
+    std::vector<tcp::endpoint> result;
+    result.reserve(v6.size() + v4.size());
+    for (std::size_t i = 0; i < std::max(v6.size(), v4.size()); ++i) {
+        if (i < v6.size()) {
+            result.push_back(v6[i]);
+        }
+        if (i < v4.size()) {
+            result.push_back(v4[i]);
+        }
+    }
+    return result;
+}
+
+} // namespace detail
+
+// Connects to 'peer', racing its addresses happy eyeballs style: every
+// address gets 'attempt_delay' of head start (or less if it fails) before
+// the next one is tried, the first established connection wins and the
+// other attempts are dropped.
+// Must run on 'strand', the returned socket's executor.
+inline awaitable<std::optional<StrandSocket<tcp>>>
+dial(Strand strand, const Peer& peer, const DialConfig& config) {
+    const auto executor = co_await this_coro::executor;
+
+    tcp::resolver resolver(executor);
+    auto [err, results] = co_await resolver.async_resolve(
+        peer.host, std::to_string(peer.port), use_nothrow_awaitable
+    );
+    if (err) {
+        log_warn("Failed resolving '{}': {}", peer.host, err.message());
+        co_return std::nullopt;
+    }
+    const auto endpoints = detail::interleave_families(results);
+
+    auto race = std::make_shared<detail::DialRace>(executor);
+    for (std::size_t i = 0; i < endpoints.size(); ++i) {
+        auto socket = std::make_shared<StrandSocket<tcp>>(strand);
+        race->attempts.push_back(socket);
+        ++race->running;
+        co_spawn(
+            executor,
+            detail::dial_attempt(
+                race, socket, endpoints[i], config.connect_timeout
+            ),
+            detached
+        );
+
+        // Wait for the head start to expire or for an attempt to complete
+        if (i + 1 < endpoints.size()) {
+            co_await race->wait_until(
+                steady_clock::now() + config.attempt_delay
+            );
+        }
+        if (race->winner.has_value()) {
+            break;
+        }
+    }
+    while (!race->winner.has_value() && race->running > 0) {
+        co_await race->wait_until(steady_clock::time_point::max());
+    }
+
+    // Abort the losers
+    for (const auto& socket : race->attempts) {
+        asio::error_code ignored;
+        socket->close(ignored);
+    }
+    co_return std::move(race->winner);
+}
+
+// Connects to a peer on the same host through its Unix domain socket
+inline awaitable<std::optional<StrandSocket<asio::local::stream_protocol>>>
+dial_local(Strand strand, const Peer& peer, const DialConfig& config) {
+    using namespace asio::experimental::awaitable_operators;
+    using local = asio::local::stream_protocol;
+
+    StrandSocket<local> socket(strand);
+    auto result = co_await (
+        socket.async_connect(
+            local::endpoint(peer.local_path), use_nothrow_awaitable
+        ) ||
+        timeout(config.connect_timeout)
+    );
+    if (result.index() != 0 || std::get<0>(std::get<0>(result))) {
+        log_warn("Failed connecting to '{}'", peer.local_path);
+        co_return std::nullopt;
+    }
+    co_return std::move(socket);
+}
+
+} // namespace peppe
@@ -0,0 +1,242 @@
+#pragma once
+
+#include "connection_table.hpp"
+#include "gossip.hpp"
+#include "logger.hpp"
+#include "message.hpp"
+#include "peer_table.hpp"
+
+#include <asio/ip/multicast.hpp>
+#include <asio/ip/udp.hpp>
+#include <asio/post.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <unordered_set>
+#include <vector>
+
+namespace peppe {
+
+struct DiscoveryConfig {
+    // Announce ourselves on the LAN and dial the nodes announcing themselves
+    bool enabled = false;
+    asio::ip::address group = asio::ip::make_address_v4("239.255.25.4");
+    asio::ip::port_type port = 2599;
+    // Interface announcements are sent and received on, the default one when
+    // unspecified. "127.0.0.1" keeps them on the host.
+    asio::ip::address interface;
+    // Time between two periodic announcements
+    std::chrono::milliseconds interval = std::chrono::seconds(5);
+};
+
+// Zero configuration bootstrap over UDP multicast. Every node periodically
+// announces its node id and TCP port on the group. A node hearing of a new
+// node announces itself early, so the newcomer learns of everyone within a
+// round trip. Only the node with the larger id dials, which keeps a single
+// connection per pair.
+// Early announcements are spaced by at least 'min_announce_interval', a
+// burst of newcomers doesn't turn into a burst of datagrams.
+// A node is dialed again on its next announcement once it is forgotten, so
+// a failed dial or a lost connection is retried. The sets of nodes are
+// bounded, datagrams with made up ids can't grow them.
+class Discovery {
+public:
+    static constexpr auto min_announce_interval =
+        std::chrono::milliseconds(100);
+    // Nodes remembered as already announced
+    static constexpr std::size_t max_heard_nodes = 1024;
+    // Nodes being dialed or connected to at once
+    static constexpr std::size_t max_dialed_nodes = 256;
+
+    // Ctor
+    explicit Discovery(asio::any_io_executor executor)
+        : m_socket(executor)
+        , m_timer(std::move(executor)) {}
+    // Copy
+    Discovery(Discovery const&) = delete;
+    Discovery& operator=(Discovery const&) = delete;
+    // Move
+    Discovery(Discovery&&) = delete;
+    Discovery& operator=(Discovery&&) = delete;
+    // Dtor
+    ~Discovery() = default;
+
+    void set_config(const DiscoveryConfig& config) { m_config = config; }
+    [[nodiscard]] const DiscoveryConfig& config() const { return m_config; }
+
+    // Must run on the executor given to the ctor. Announces 'port' and calls
+    // 'on_peer(Peer, node_id)' for every node to dial.
+    template<typename OnPeer>
+    awaitable<void> run(
+        std::uint64_t node_id,
+        asio::ip::port_type port,
+        std::string name,
+        OnPeer on_peer
+    ) {
+        m_node_id = node_id;
+        Announce announce{ .node_id = node_id, .port = port };
+        announce.name = std::move(name);
+        announce.name.resize(
+            std::min(announce.name.size(), String<std::uint8_t>::max_size)
+        );
+        m_announcement.resize(Codec<Announce>::encoded_size(announce));
+        Codec<Announce>::encode(announce, m_announcement.data());
+
+        try {
+            open();
+        }
+        catch (const std::system_error& e) {
+            log_warn("Discovery disabled: {}", e.what());
+            co_return;
+        }
+        log_info(
+            "Discovering peers on {}:{}",
+            m_config.group.to_string(),
+            m_config.port
+        );
+
+        co_spawn(m_socket.get_executor(), announcer(), detached);
+        co_await receiver(std::move(on_peer));
+    }
+
+    // The dial of 'node_id' failed or its session ended, from any thread
+    void forget(std::uint64_t node_id) {
+        asio::post(m_socket.get_executor(), [this, node_id] {
+            m_dialed_nodes.erase(node_id);
+        });
+    }
+
+private:
+    void open() {
+        const auto& group = m_config.group;
+        const auto& interface = m_config.interface;
+        const udp::endpoint listen_endpoint(
+            group.is_v6() ? udp::v6() : udp::v4(), m_config.port
+        );
+        m_socket.open(listen_endpoint.protocol());
+        // Every node of the host listens on the same port
+        m_socket.set_option(udp::socket::reuse_address(true));
+        m_socket.bind(listen_endpoint);
+
+        if (group.is_v4() && interface.is_v4()) {
+            m_socket.set_option(asio::ip::multicast::join_group(
+                group.to_v4(), interface.to_v4()
+            ));
+            m_socket.set_option(
+                asio::ip::multicast::outbound_interface(interface.to_v4())
+            );
+        }
+        else {
+            m_socket.set_option(asio::ip::multicast::join_group(group));
+        }
+        // Nodes of the same host hear each other, nothing leaves the LAN
+        m_socket.set_option(asio::ip::multicast::enable_loopback(true));
+        m_socket.set_option(asio::ip::multicast::hops(1));
+        m_group_endpoint = udp::endpoint(group, m_config.port);
+    }
+
+    awaitable<void> announcer() {
+        while (m_socket.is_open()) {
+            co_await m_socket.async_send_to(
+                asio::buffer(m_announcement),
+                m_group_endpoint,
+                use_nothrow_awaitable
+            );
+            m_last_announce = steady_clock::now();
+
+            // announce_soon() moves the expiry earlier, which aborts the wait
+            m_timer.expires_after(m_config.interval);
+            while (true) {
+                auto [err] =
+                    co_await m_timer.async_wait(use_nothrow_awaitable);
+                if (!err) {
+                    break;
+                }
+                if (!m_socket.is_open()) {
+                    co_return;
+                }
+            }
+        }
+    }
+
+    void announce_soon() {
+        const auto at = std::max(
+            m_last_announce + min_announce_interval, steady_clock::now()
+        );
+        if (at < m_timer.expiry()) {
+            m_timer.expires_at(at);
+        }
+    }
+
+    template<typename OnPeer>
+    awaitable<void> receiver(OnPeer on_peer) {
+        std::array<std::uint8_t, 512> buffer{};
+        udp::endpoint sender;
+        while (true) {
+            auto [err, len] = co_await m_socket.async_receive_from(
+                asio::buffer(buffer), sender, use_nothrow_awaitable
+            );
+            if (err == asio::error::operation_aborted) {
+                break;
+            }
+            if (err) {
+                continue;
+            }
+
+            // Foreign or truncated datagrams are ignored
+            ByteReader reader(std::span(buffer.data(), len));
+            MessageType tag{};
+            if (!BigEndian<MessageType>::decode(reader, tag) ||
+                tag != MessageType::AnnounceType) {
+                continue;
+            }
+            const auto announce = Codec<Announce>::decode(reader);
+            if (!announce.has_value() ||
+                announce->magic != Announce::expected_magic ||
+                announce->node_id == m_node_id) {
+                continue;
+            }
+
+            if (m_heard_nodes.insert(announce->node_id)) {
+                log_info(
+                    "Discovered '{}' at {}:{}",
+                    announce->name,
+                    sender.address().to_string(),
+                    announce->port
+                );
+                // Let the newcomer know about us
+                announce_soon();
+            }
+            if (announce->node_id < m_node_id &&
+                m_dialed_nodes.size() < max_dialed_nodes &&
+                m_dialed_nodes.insert(announce->node_id).second) {
+                on_peer(
+                    Peer{ .host = sender.address().to_string(),
+                          .port = announce->port },
+                    announce->node_id
+                );
+            }
+        }
+        m_timer.cancel();
+    }
+
+    using udp = asio::ip::udp;
+
+    DiscoveryConfig m_config;
+    std::uint64_t m_node_id = 0;
+    std::vector<std::uint8_t> m_announcement;
+    udp::socket m_socket;
+    udp::endpoint m_group_endpoint;
+    asio::steady_timer m_timer;
+    steady_clock::time_point m_last_announce;
+    DuplicateFilter m_heard_nodes{ max_heard_nodes };
+    // Dial in flight or connected
+    std::unordered_set<std::uint64_t> m_dialed_nodes;
+};
+
+} // namespace peppe
@@ -3,11 +3,14 @@
 #include "utils.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
-#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <type_traits>
-#include <typeindex>
+#include <vector>
 
 namespace peppe {
 
@@ -25,7 +28,7 @@ struct CompoundEvent
     template<typename K>
         requires(std::is_same_v<K, E> || ...)
     CompoundEvent(K&& event)
-        : Variant<E...>(event) {}
+        : Variant<E...>(std::forward<K>(event)) {}
 
     template<typename... F>
     void match(F&&... funcs) const {
@@ -33,9 +36,19 @@ struct CompoundEvent
     }
 };
 
+// See chat_message.hpp
+class ChatMessage;
+
+// One or more texts received in a single frame. The message is shared with
+// every listener, copying the event only copies the reference.
 struct ReceiveMessage {
+    std::shared_ptr<const ChatMessage> message;
+};
+
+// File received from a peer, saved at 'path'
+struct ReceiveFile {
     std::string from;
-    std::string message;
+    std::string path;
 };
 
 struct SetPeerName {
@@ -46,16 +59,25 @@ struct PeerConnected {};
 
 struct PeerDisconnected {};
 
-using BackendEvent =
-    CompoundEvent<ReceiveMessage, SetPeerName, PeerConnected, PeerDisconnected>;
+using BackendEvent = CompoundEvent<
+    ReceiveMessage,
+    ReceiveFile,
+    SetPeerName,
+    PeerConnected,
+    PeerDisconnected>;
 
 struct SendMessage {
     std::string message;
 };
 
+// Offers a file to every connected peer
+struct SendFile {
+    std::string path;
+};
+
 struct Terminate {};
 
-using FrontendEvent = CompoundEvent<SendMessage, Terminate>;
+using FrontendEvent = CompoundEvent<SendMessage, SendFile, Terminate>;
 
 //////////////////////////////////
 // Event handler                //
@@ -67,49 +89,55 @@ concept IsEvent = std::is_base_of_v<Event, E>;
 template<typename T, typename E>
 concept HasOnEvent = requires(T t, E e) { t.on_event(e); };
 
+// Type-erased callback for events of type 'E': an instance pointer and a
+// plain function pointer, no allocation and no std::function.
+template<IsEvent E>
 class EventHandler {
 public:
-    using HandlerID = std::uintptr_t;
+    using HandlerID = std::uint64_t;
+
+    // Calls 'instance->Func(event)'
+    template<auto Func, typename T>
+    [[nodiscard]] static EventHandler bind(T* instance) {
+        return EventHandler(instance, [](void* obj, E const& event) {
+            (static_cast<T*>(obj)->*Func)(event);
+        });
+    }
 
-    template<typename T, IsEvent E>
-    explicit EventHandler(T* instance, void (T::*func)(E const&))
-        : handler_id{ id_counter++ }
-        , event_type_id{ typeid(E) }
-        , handler{ [instance, func](Event const& event) {
-            return (instance->*func)(static_cast<const E&>(event));
-        } } {}
+    // Calls 'Func(event)'
+    template<void (*Func)(E const&)>
+    [[nodiscard]] static EventHandler bind() {
+        return EventHandler(nullptr, [](void*, E const& event) {
+            Func(event);
+        });
+    }
 
-    template<IsEvent E>
-    explicit EventHandler(void (*func)(E const&))
-        : handler_id{ id_counter++ }
-        , event_type_id{ typeid(E) }
-        , handler{ [func](Event const& event) {
-            return (*func)(static_cast<const E&>(event));
-        } } {}
-
-    // Copy
-    EventHandler(EventHandler const&) = default;
-    EventHandler& operator=(EventHandler const&) = default;
-    // Move
-    EventHandler(EventHandler&&) = default;
-    EventHandler& operator=(EventHandler&&) = default;
-    // Dtor
-    ~EventHandler() = default;
+    // Calls 'instance->T::on_event(event)', bypassing the vtable
+    template<typename T>
+        requires HasOnEvent<T, E>
+    [[nodiscard]] static EventHandler from_listener(T* instance) {
+        return EventHandler(instance, [](void* obj, E const& event) {
+            static_cast<T*>(obj)->T::on_event(event);
+        });
+    }
 
     [[nodiscard]] constexpr HandlerID id() const { return handler_id; }
 
-    // FIXME: Call operator
-    template<typename E>
-    void operator()(E const& e) {
-        handler(e);
-    }
+    void operator()(E const& event) const { m_invoke(m_instance, event); }
 
-    // private:
-    static inline HandlerID id_counter = 0;
+private:
+    using Invoke = void (*)(void*, E const&);
+
+    EventHandler(void* instance, Invoke invoke)
+        : handler_id{ id_counter.fetch_add(1, std::memory_order_relaxed) }
+        , m_instance{ instance }
+        , m_invoke{ invoke } {}
+
+    static inline std::atomic<HandlerID> id_counter = 0;
 
     HandlerID handler_id;
-    std::type_index event_type_id;
-    std::function<void(Event const&)> handler;
+    void* m_instance;
+    Invoke m_invoke;
 };
 
 ////////////////////////////////////////////////
@@ -120,59 +148,45 @@ class EventManager {
 public:
     EventManager() = delete;
 
-    template<typename E>
-        requires std::is_base_of_v<Event, E>
+    // The handler list of each event type is resolved at compile time. The
+    // event is passed by reference to every handler, never copied.
+    template<IsEvent E>
     static void send(E const& event) {
-        E e = event;
-        auto it = std::ranges::find_if(m_handlers, [](auto const& p) {
-            return p.first == typeid(E);
-        });
-
-        if (it != m_handlers.end()) {
-            for (auto const& event_handler : it->second) {
-                event_handler.handler(e);
-            }
+        auto& reg = registry<E>();
+        std::shared_lock lock(reg.mutex);
+        for (auto const& event_handler : reg.handlers) {
+            event_handler(event);
         }
     }
 
-    static void add_listener(EventHandler&& event_handler) {
-        auto const event_type_id = event_handler.event_type_id;
-        auto it =
-            std::ranges::find_if(m_handlers, [event_type_id](auto const& p) {
-                return p.first == event_type_id;
-            });
-
-        if (it != m_handlers.end()) {
-            it->second.push_back(std::move(event_handler));
-        }
-        else {
-            m_handlers.emplace_back(
-                event_type_id,
-                std::move(std::vector{ std::move(event_handler) })
-            );
-        }
+    template<IsEvent E>
+    static void add_listener(EventHandler<E>&& event_handler) {
+        auto& reg = registry<E>();
+        std::unique_lock lock(reg.mutex);
+        reg.handlers.push_back(std::move(event_handler));
     }
 
-    static void remove_listener(
-        std::type_index type_idx,
-        EventHandler::HandlerID handler_id
-    ) {
-        auto it = std::ranges::find_if(m_handlers, [type_idx](auto const& p) {
-            return p.first == type_idx;
+    template<IsEvent E>
+    static void remove_listener(typename EventHandler<E>::HandlerID id) {
+        auto& reg = registry<E>();
+        std::unique_lock lock(reg.mutex);
+        std::erase_if(reg.handlers, [id](const EventHandler<E>& eh) {
+            return id == eh.id();
         });
-
-        auto rm_it = std::remove_if(
-            it->second.begin(),
-            it->second.end(),
-            [handler_id](EventHandler& eh) { return handler_id == eh.id(); }
-        );
-        it->second.erase(rm_it, it->second.end());
     }
 
 private:
-    using EventToHandlers =
-        std::pair<std::type_index, std::vector<EventHandler>>;
-    static inline std::vector<EventToHandlers> m_handlers = {};
+    template<IsEvent E>
+    struct Registry {
+        std::shared_mutex mutex;
+        std::vector<EventHandler<E>> handlers;
+    };
+
+    template<IsEvent E>
+    static Registry<E>& registry() {
+        static Registry<E> instance;
+        return instance;
+    }
 };
 
 ////////////////////////////////////////////////
@@ -184,20 +198,17 @@ template<typename T, typename E>
 class EventListener {
 public:
     EventListener() {
-        auto handler = EventHandler(
-            static_cast<T*>(this),
-            static_cast<void (T::*)(E const&)>(&T::on_event)
-        );
+        auto handler = EventHandler<E>::from_listener(static_cast<T*>(this));
         m_handler_id = handler.id();
         EventManager::add_listener(std::move(handler));
     }
 
-    ~EventListener() { EventManager::remove_listener(typeid(E), m_handler_id); }
+    ~EventListener() { EventManager::remove_listener<E>(m_handler_id); }
 
     virtual void on_event(E const&) = 0;
 
 private:
-    EventHandler::HandlerID m_handler_id;
+    typename EventHandler<E>::HandlerID m_handler_id;
 };
 
 } // namespace peppe
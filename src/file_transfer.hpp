@@ -0,0 +1,607 @@
+#pragma once
+
+#include "frame_reader.hpp"
+#include "gossip.hpp"
+#include "logger.hpp"
+#include "message.hpp"
+
+#include <asio/awaitable.hpp>
+#include <asio/buffer.hpp>
+#include <asio/write.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#    include <sys/sendfile.h>
+#endif
+
+namespace peppe {
+
+struct FileTransferConfig {
+    // A FileChunk frame must fit in the receiver's frame buffer
+    static constexpr std::size_t max_chunk_size =
+        FrameReader::max_capacity - FileChunk::header_size;
+
+    // Offered files are saved in this directory, empty declines every offer
+    std::string download_dir;
+    // Larger offers are declined
+    std::uint64_t max_file_size = std::uint64_t(4) << 30;
+    // Data sent per FileChunk frame
+    std::size_t chunk_size = 128 * 1024;
+    // Bytes a transfer sends ahead of the receiver's acknowledgements. Chat
+    // frames are interleaved between chunks, but still wait behind the file
+    // data already in the socket buffers: the window bounds that delay. It
+    // must cover the bandwidth-delay product for full speed on slow links.
+    std::size_t window = 1024 * 1024;
+};
+
+///////////////////////////////
+// Sending                   //
+///////////////////////////////
+
+// File opened for sending, shared by its transfers to every peer
+class FileSource {
+public:
+    // nullptr if the file can't be read
+    [[nodiscard]] static std::shared_ptr<FileSource>
+    open(const std::string& path) {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return nullptr;
+        }
+        struct stat info {};
+        if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            ::close(fd);
+            return nullptr;
+        }
+        auto name = std::filesystem::path(path).filename().string();
+        const auto id = identity(info, name);
+        return std::shared_ptr<FileSource>(new FileSource(
+            fd, std::uint64_t(info.st_size), std::move(name), id
+        ));
+    }
+
+    // Copy
+    FileSource(FileSource const&) = delete;
+    FileSource& operator=(FileSource const&) = delete;
+    // Move
+    FileSource(FileSource&&) = delete;
+    FileSource& operator=(FileSource&&) = delete;
+    // Dtor
+    ~FileSource() { ::close(m_fd); }
+
+    [[nodiscard]] int fd() const { return m_fd; }
+    [[nodiscard]] std::uint64_t size() const { return m_size; }
+    [[nodiscard]] const std::string& name() const { return m_name; }
+    // Same id on every connection the file is offered on, and for every
+    // offer of the unchanged file: the receiver resumes only on a match
+    [[nodiscard]] std::uint64_t id() const { return m_id; }
+
+private:
+    [[nodiscard]] static std::uint64_t
+    identity(const struct stat& info, std::string_view name) {
+        std::uint64_t hash = mix64(std::uint64_t(info.st_dev));
+        hash = mix64(hash ^ std::uint64_t(info.st_ino));
+        hash = mix64(hash ^ std::uint64_t(info.st_size));
+        hash = mix64(hash ^ std::uint64_t(info.st_mtim.tv_sec));
+        hash = mix64(hash ^ std::uint64_t(info.st_mtim.tv_nsec));
+        for (const char c : name) {
+            hash = mix64(hash ^ std::uint8_t(c));
+        }
+        return hash;
+    }
+
+    // Ctor
+    FileSource(int fd, std::uint64_t size, std::string name, std::uint64_t id)
+        : m_fd(fd)
+        , m_size(size)
+        , m_name(std::move(name))
+        , m_id(id) {}
+
+    int m_fd;
+    std::uint64_t m_size;
+    std::string m_name;
+    std::uint64_t m_id;
+};
+
+// Chunk the writer may send right away
+struct FileChunkJob {
+    std::shared_ptr<FileSource> source;
+    std::uint64_t offset = 0;
+    std::size_t size = 0;
+};
+
+// Files offered on a connection. offer() is called from any thread, the
+// rest from the session's strand.
+class OutgoingTransfers {
+public:
+    void set_config(const FileTransferConfig& config) {
+        std::lock_guard lock(m_mutex);
+        m_config = config;
+    }
+
+    // Returns false if the file is already offered on this connection
+    bool offer(std::shared_ptr<FileSource> source) {
+        std::lock_guard lock(m_mutex);
+        if (find(source->id()) != m_transfers.end()) {
+            return false;
+        }
+        m_transfers.push_back(Transfer{ .source = std::move(source) });
+        return true;
+    }
+
+    // The receiver won't take the file, an accepted transfer is kept
+    void decline(std::uint64_t id) {
+        std::lock_guard lock(m_mutex);
+        auto it = find(id);
+        if (it == m_transfers.end() || it->accepted) {
+            return;
+        }
+        log_info("'{}' was declined", it->source->name());
+        m_transfers.erase(it);
+        m_next = 0;
+    }
+
+    // The receiver already has the bytes before 'offset'
+    void accept(std::uint64_t id, std::uint64_t offset) {
+        std::lock_guard lock(m_mutex);
+        auto it = find(id);
+        if (it == m_transfers.end() || it->accepted) {
+            return;
+        }
+        it->accepted = true;
+        it->next_offset = it->acked = std::min(offset, it->source->size());
+        it->start = std::chrono::steady_clock::now();
+        if (it->acked == it->source->size()) {
+            finish(it);
+        }
+    }
+
+    void ack(std::uint64_t id, std::uint64_t offset) {
+        std::lock_guard lock(m_mutex);
+        auto it = find(id);
+        if (it == m_transfers.end() || offset > it->next_offset) {
+            return;
+        }
+        it->acked = std::max(it->acked, offset);
+        if (it->acked == it->source->size()) {
+            finish(it);
+        }
+    }
+
+    // Next chunk of the accepted transfers, round robin, within their
+    // window. std::nullopt when every window is full.
+    [[nodiscard]] std::optional<FileChunkJob> next_chunk() {
+        std::lock_guard lock(m_mutex);
+        for (std::size_t i = 0; i < m_transfers.size(); ++i) {
+            auto& transfer = m_transfers[(m_next + i) % m_transfers.size()];
+            const auto size = transfer.source->size();
+            const auto in_flight = transfer.next_offset - transfer.acked;
+            if (!transfer.accepted || transfer.next_offset == size ||
+                in_flight >= m_config.window) {
+                continue;
+            }
+            const auto chunk_size = std::min<std::uint64_t>(
+                { m_config.chunk_size,
+                  size - transfer.next_offset,
+                  m_config.window - in_flight }
+            );
+            FileChunkJob job{ .source = transfer.source,
+                              .offset = transfer.next_offset,
+                              .size = std::size_t(chunk_size) };
+            transfer.next_offset += chunk_size;
+            m_next = (m_next + i + 1) % m_transfers.size();
+            return job;
+        }
+        return std::nullopt;
+    }
+
+private:
+    struct Transfer {
+        std::shared_ptr<FileSource> source;
+        bool accepted = false;
+        std::uint64_t next_offset = 0;
+        std::uint64_t acked = 0;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    std::vector<Transfer>::iterator find(std::uint64_t id) {
+        return std::ranges::find_if(m_transfers, [id](const Transfer& t) {
+            return t.source->id() == id;
+        });
+    }
+
+    void finish(std::vector<Transfer>::iterator it) {
+        const auto elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - it->start
+        );
+        const auto size = it->source->size();
+        log_info(
+            "Sent '{}' ({} bytes) in {:.3f} s",
+            it->source->name(),
+            size,
+            elapsed.count()
+        );
+        m_transfers.erase(it);
+        m_next = 0;
+    }
+
+    mutable std::mutex m_mutex;
+    FileTransferConfig m_config;
+    std::vector<Transfer> m_transfers;
+    // Round robin position
+    std::size_t m_next = 0;
+};
+
+// Writes 'size' bytes of 'fd' from 'offset' to 'socket'. On Linux the bytes
+// go from the page cache to the socket with sendfile(), never through user
+// space. Returns false if the socket or the file failed.
+template<typename Socket>
+asio::awaitable<bool> send_file_range(
+    Socket& socket,
+    int fd,
+    std::uint64_t offset,
+    std::size_t size
+) {
+#if defined(__linux__)
+    socket.native_non_blocking(true);
+    while (size > 0) {
+        auto file_offset = off_t(offset);
+        const auto sent =
+            ::sendfile(socket.native_handle(), fd, &file_offset, size);
+        if (sent > 0) {
+            offset += std::uint64_t(sent);
+            size -= std::size_t(sent);
+        }
+        else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            auto [err] = co_await socket.async_wait(
+                Socket::wait_write, use_nothrow_awaitable
+            );
+            if (err) {
+                co_return false;
+            }
+        }
+        else if (sent == 0 || errno != EINTR) {
+            // The file shrank or the socket failed
+            co_return false;
+        }
+    }
+    co_return true;
+#else
+    std::vector<std::uint8_t> buffer(std::min<std::size_t>(size, 64 * 1024));
+    while (size > 0) {
+        const auto count = std::min(size, buffer.size());
+        const auto read = ::pread(fd, buffer.data(), count, off_t(offset));
+        if (read <= 0) {
+            co_return false;
+        }
+        auto [err, len] = co_await asio::async_write(
+            socket,
+            asio::buffer(buffer.data(), std::size_t(read)),
+            use_nothrow_awaitable
+        );
+        if (err) {
+            co_return false;
+        }
+        offset += std::uint64_t(read);
+        size -= std::size_t(read);
+    }
+    co_return true;
+#endif
+}
+
+///////////////////////////////
+// Receiving                 //
+///////////////////////////////
+
+// Files being received on a connection, only accessed from the session's
+// strand. Data goes to '<name>.part', preallocated, renamed once complete.
+// The part file only grows with the data written, its size is where an
+// interrupted transfer resumes from. '<name>.part.id' records the file the
+// part belongs to, a different file with the same name starts over.
+class IncomingTransfers {
+public:
+    // Ctor
+    IncomingTransfers() = default;
+    // Copy
+    IncomingTransfers(IncomingTransfers const&) = delete;
+    IncomingTransfers& operator=(IncomingTransfers const&) = delete;
+    // Move
+    IncomingTransfers(IncomingTransfers&&) = delete;
+    IncomingTransfers& operator=(IncomingTransfers&&) = delete;
+    // Dtor
+    ~IncomingTransfers() {
+        for (const auto& [id, transfer] : m_transfers) {
+            ::close(transfer.fd);
+            active_paths().release(transfer.path);
+        }
+    }
+
+    void set_config(const FileTransferConfig& config) { m_config = config; }
+
+    struct Progress {
+        // Bytes of the file written so far
+        std::uint64_t offset = 0;
+        // Set once the file is complete
+        std::optional<std::string> completed_path;
+    };
+
+    // Opens the part file of an offer. Returns the offset to accept it from,
+    // std::nullopt declines it.
+    [[nodiscard]] std::optional<Progress> offer(const FileOffer& offer) {
+        if (m_config.download_dir.empty() ||
+            m_transfers.contains(offer.transfer_id)) {
+            return std::nullopt;
+        }
+        if (offer.size > m_config.max_file_size) {
+            log_warn(
+                "Declined '{}': {} bytes is over the limit",
+                offer.name,
+                offer.size
+            );
+            return std::nullopt;
+        }
+        // Never write outside of the download directory
+        const auto name = std::filesystem::path(offer.name).filename();
+        if (name.empty() || name == "." || name == "..") {
+            return std::nullopt;
+        }
+        const std::filesystem::path directory(m_config.download_dir);
+        std::error_code ignored;
+        std::filesystem::create_directories(directory, ignored);
+
+        // Reserved until the transfer ends, by any connection
+        auto path = active_paths().reserve(directory, name);
+        if (!path.has_value()) {
+            log_warn("Declined '{}': no free file name", offer.name);
+            return std::nullopt;
+        }
+        Transfer transfer{ .id = offer.transfer_id,
+                           .size = offer.size,
+                           .part_path = *path,
+                           .path = std::move(*path) };
+        transfer.part_path += ".part";
+        auto result = open_part(transfer);
+        if (!result.has_value()) {
+            active_paths().release(transfer.path);
+            return std::nullopt;
+        }
+
+        const auto [it, inserted] =
+            m_transfers.emplace(offer.transfer_id, std::move(transfer));
+        if (it->second.offset == it->second.size) {
+            return complete(it);
+        }
+        return result;
+    }
+
+    // Writes a chunk at the end of its file. std::nullopt if the transfer is
+    // unknown or failed.
+    [[nodiscard]] std::optional<Progress> write(const FileChunk& chunk) {
+        auto it = m_transfers.find(chunk.transfer_id);
+        if (it == m_transfers.end()) {
+            return std::nullopt;
+        }
+        auto& transfer = it->second;
+        if (chunk.offset != transfer.offset ||
+            chunk.data.size() > transfer.size - transfer.offset) {
+            fail(it, "out of order chunk");
+            return std::nullopt;
+        }
+
+        auto data = chunk.data;
+        while (!data.empty()) {
+            const auto written = ::pwrite(
+                transfer.fd, data.data(), data.size(), off_t(transfer.offset)
+            );
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                fail(it, "write failed");
+                return std::nullopt;
+            }
+            transfer.offset += std::uint64_t(written);
+            data = data.subspan(std::size_t(written));
+        }
+
+        if (transfer.offset == transfer.size) {
+            return complete(it);
+        }
+        return Progress{ .offset = transfer.offset };
+    }
+
+private:
+    struct Transfer {
+        std::uint64_t id = 0;
+        int fd = -1;
+        std::uint64_t size = 0;
+        std::uint64_t offset = 0;
+        std::filesystem::path part_path;
+        std::filesystem::path path;
+    };
+    using Iterator = std::unordered_map<std::uint64_t, Transfer>::iterator;
+
+    // Target files of the transfers in progress, on every connection
+    class ActivePaths {
+    public:
+        static constexpr int max_attempts = 1000;
+
+        // 'name', else 'name (1)', 'name (2)'... The first one that is
+        // neither an existing file nor the target of another transfer.
+        [[nodiscard]] std::optional<std::filesystem::path> reserve(
+            const std::filesystem::path& directory,
+            const std::filesystem::path& name
+        ) {
+            std::lock_guard lock(m_mutex);
+            for (int i = 0; i < max_attempts; ++i) {
+                auto path = directory / name;
+                if (i > 0) {
+                    path = directory / fmt::format(
+                                           "{} ({}){}",
+                                           name.stem().string(),
+                                           i,
+                                           name.extension().string()
+                                       );
+                }
+                std::error_code err;
+                if (!m_paths.contains(path.string()) &&
+                    !std::filesystem::exists(path, err) && !err) {
+                    m_paths.insert(path.string());
+                    return path;
+                }
+            }
+            return std::nullopt;
+        }
+
+        void release(const std::filesystem::path& path) {
+            std::lock_guard lock(m_mutex);
+            m_paths.erase(path.string());
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::unordered_set<std::string> m_paths;
+    };
+
+    [[nodiscard]] static ActivePaths& active_paths() {
+        static ActivePaths instance;
+        return instance;
+    }
+
+    [[nodiscard]] static std::filesystem::path
+    id_path(const Transfer& transfer) {
+        auto path = transfer.part_path;
+        path += ".id";
+        return path;
+    }
+
+    // Opens the part file, resuming it if it belongs to the same file
+    std::optional<Progress> open_part(Transfer& transfer) {
+        transfer.fd = ::open(
+            transfer.part_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644
+        );
+        if (transfer.fd < 0) {
+            log_error("Failed opening '{}'", transfer.part_path.string());
+            return std::nullopt;
+        }
+
+        const auto identity = fmt::format("{} {}", transfer.id, transfer.size);
+        std::string recorded;
+        if (std::ifstream in(id_path(transfer)); in) {
+            std::getline(in, recorded);
+        }
+        struct stat info {};
+        if (recorded == identity && ::fstat(transfer.fd, &info) == 0 &&
+            std::uint64_t(info.st_size) <= transfer.size) {
+            transfer.offset = std::uint64_t(info.st_size);
+            if (transfer.offset > 0) {
+                log_info(
+                    "Resuming '{}' at {}",
+                    transfer.path.string(),
+                    transfer.offset
+                );
+            }
+        }
+        else if (::ftruncate(transfer.fd, 0) != 0 ||
+                 !(std::ofstream(id_path(transfer)) << identity << '\n')) {
+            ::close(transfer.fd);
+            return std::nullopt;
+        }
+
+        // The blocks still missing must fit on the disk
+        std::error_code err;
+        const auto space =
+            std::filesystem::space(transfer.part_path.parent_path(), err);
+        const auto missing = transfer.size - transfer.offset;
+        if (err || missing > space.available) {
+            log_warn(
+                "Declined '{}': {} bytes don't fit on the disk",
+                transfer.path.string(),
+                missing
+            );
+            ::close(transfer.fd);
+            return std::nullopt;
+        }
+#if defined(__linux__)
+        // Reserve the blocks without changing the file size, best effort
+        if (missing > 0) {
+            ::fallocate(
+                transfer.fd,
+                FALLOC_FL_KEEP_SIZE,
+                off_t(transfer.offset),
+                off_t(missing)
+            );
+        }
+#endif
+        return Progress{ .offset = transfer.offset };
+    }
+
+    Progress complete(Iterator it) {
+        auto& transfer = it->second;
+        ::close(transfer.fd);
+        // A file created at the target since the offer is never replaced
+#if defined(__linux__)
+        const bool renamed = ::renameat2(
+                                 AT_FDCWD,
+                                 transfer.part_path.c_str(),
+                                 AT_FDCWD,
+                                 transfer.path.c_str(),
+                                 RENAME_NOREPLACE
+                             ) == 0;
+#else
+        const bool renamed =
+            ::link(transfer.part_path.c_str(), transfer.path.c_str()) == 0 &&
+            ::unlink(transfer.part_path.c_str()) == 0;
+#endif
+        if (renamed) {
+            std::error_code ignored;
+            std::filesystem::remove(id_path(transfer), ignored);
+        }
+        else {
+            log_error(
+                "Failed renaming '{}': {}",
+                transfer.part_path.string(),
+                std::strerror(errno)
+            );
+        }
+        Progress result{ .offset = transfer.offset,
+                         .completed_path = transfer.path.string() };
+        active_paths().release(transfer.path);
+        m_transfers.erase(it);
+        return result;
+    }
+
+    // The part file is kept for a later attempt to resume from
+    void fail(Iterator it, std::string_view reason) {
+        log_warn(
+            "Transfer of '{}' aborted: {}", it->second.path.string(), reason
+        );
+        ::close(it->second.fd);
+        active_paths().release(it->second.path);
+        m_transfers.erase(it);
+    }
+
+    FileTransferConfig m_config;
+    std::unordered_map<std::uint64_t, Transfer> m_transfers;
+};
+
+} // namespace peppe
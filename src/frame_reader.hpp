@@ -0,0 +1,79 @@
+#pragma once
+
+#include <asio/buffer.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+#include "error.hpp"
+#include "message.hpp"
+
+namespace peppe {
+
+struct ReceiveStats {
+    // Number of read operations issued on the socket
+    std::atomic<std::uint64_t> reads = 0;
+    std::atomic<std::uint64_t> frames = 0;
+    std::atomic<std::uint64_t> bytes = 0;
+};
+
+// Per-session receive buffer. The socket is read in large chunks and every
+// complete frame in the buffer is decoded in one pass, a partial frame stays
+// in the buffer until the rest of it arrives.
+class FrameReader {
+public:
+    static constexpr std::size_t default_capacity = 64 * 1024;
+    // Larger frames are considered malicious
+    static constexpr std::size_t max_capacity = 16 * 1024 * 1024;
+
+    // Ctor
+    FrameReader()
+        : m_data(default_capacity) {}
+
+    // Free space at the end of the buffer to read into
+    [[nodiscard]] asio::mutable_buffer prepare() {
+        if (m_begin == m_end) {
+            m_begin = m_end = 0;
+        }
+        else if (m_end == m_data.size() && m_begin > 0) {
+            // Move the partial frame to the front
+            std::memmove(m_data.data(), m_data.data() + m_begin, size());
+            m_end -= m_begin;
+            m_begin = 0;
+        }
+
+        if (m_end == m_data.size()) {
+            // A single frame doesn't fit in the buffer
+            if (m_data.size() * 2 > max_capacity) {
+                throw ConnectionClosed();
+            }
+            m_data.resize(m_data.size() * 2);
+        }
+        return asio::buffer(m_data.data() + m_end, m_data.size() - m_end);
+    }
+
+    void commit(std::size_t count) { m_end += count; }
+
+    // Decodes the next complete frame, if any
+    [[nodiscard]] std::optional<Packet> next() {
+        ByteReader reader(
+            std::span<const std::uint8_t>(m_data.data() + m_begin, size())
+        );
+        auto packet = Packet::decode(reader);
+        m_begin += reader.consumed();
+        return packet;
+    }
+
+    [[nodiscard]] std::size_t size() const { return m_end - m_begin; }
+
+private:
+    std::vector<std::uint8_t> m_data;
+    std::size_t m_begin = 0;
+    std::size_t m_end = 0;
+};
+
+} // namespace peppe
@@ -1,86 +1,295 @@
 #include "frontend.hpp"
 #include "fmt/base.h"
+#include "metrics.hpp"
 #include <ftxui/screen/color.hpp>
+#include <ftxui/screen/string.hpp>
+#include <ftxui/screen/terminal.hpp>
+
+#include <algorithm>
 
 using namespace ftxui;
 
 namespace peppe {
 
-Frontend::Frontend(std::string&& name)
+namespace {
+
+// Number of rows 'content' takes once wrapped by paragraph() at 'width'
+int wrapped_line_count(std::string_view content, int width) {
+    if (width <= 0) {
+        return 1;
+    }
+    int lines = 1;
+    int line_width = 0;
+    for (const auto word : split(content, ' ')) {
+        const int word_width = string_width(std::string(word));
+        if (line_width > 0 && line_width + 1 + word_width > width) {
+            ++lines;
+            line_width = word_width;
+        }
+        else {
+            line_width += (line_width > 0 ? 1 : 0) + word_width;
+        }
+    }
+    return lines;
+}
+
+Element render_log_line(const LogLine& line) {
+    const auto epoch = std::chrono::system_clock::to_time_t(line.time);
+    std::tm time{};
+    localtime_r(&epoch, &time);
+    auto level = text(fmt::format(" {:<5} ", to_string(line.level)));
+    switch (line.level) {
+        case LogLevel::Debug: {
+            level |= color(Color::GrayDark);
+            break;
+        }
+        case LogLevel::Info: {
+            break;
+        }
+        case LogLevel::Warn: {
+            level |= color(Color::Yellow);
+            break;
+        }
+        case LogLevel::Error: {
+            level |= color(Color::Red);
+            break;
+        }
+    }
+    return hbox({ text(fmt::format(" {:%H:%M:%S}", time)) |
+                      color(Color::GrayDark),
+                  level,
+                  text(line.text) });
+}
+
+Element render_msg(const HistoryRecord& msg) {
+    const auto epoch = std::time_t(msg.timestamp);
+    std::tm time{};
+    localtime_r(&epoch, &time);
+    auto time_txt = fmt::format("  {:%H:%M}", time);
+    auto name_text = text(std::string(msg.username)) | bold;
+    if (msg.is_me) {
+        name_text |= color(Color::Yellow);
+    }
+    return hbox(
+        { separatorEmpty(),
+          vbox({ hbox({ name_text, text(time_txt) | color(Color::GrayDark) }),
+                 paragraph(std::string(msg.content)),
+                 separatorEmpty() }) }
+    );
+}
+
+} // namespace
+
+Frontend::Frontend(std::string&& name, MessageLog& history)
     : m_client_name(std::move(name))
+    , m_history_ref(history)
+    , m_history_size(history.size())
     , m_input_component(Input(&m_input_message, "Write something"))
     , m_component(Container::Vertical({
           m_input_component,
       })) {
+    // The panel follows the new lines
+    Logger::global().set_on_flush([this] { request_redraw(); });
     m_renderer = Renderer(m_component, [this] {
-        // Message component
-        auto msg_comp = [](const Msg& msg) {
-            auto time_txt = fmt::format("  {:%H:%M}", msg.time);
-            // fmt::print(stderr, "{}: is_me({})\n", msg.username, msg.is_me);
-            auto name_text = text(msg.username) | bold;
-            if (msg.is_me) {
-                name_text |= color(Color::Yellow);
-            }
-            return hbox(
-                { separatorEmpty(),
-                  vbox({ hbox({ name_text,
-                                text(time_txt) | color(Color::GrayDark) }),
-                         paragraph(msg.content),
-                         separatorEmpty() }) }
-            );
-        };
-
-        // Create message list component
-        std::vector<Element> msgs_comp;
-        for (auto const& msg : m_history) {
-            msgs_comp.emplace_back(msg_comp(msg));
+        // Only the visible part of the history is laid out
+        const auto terminal = Terminal::Size();
+        const int history_width = terminal.dimx - history_margin_x;
+        const int history_height = terminal.dimy - history_margin_y;
+
+        // Events dropped because the UI couldn't keep up
+        const auto dropped = m_backend_events.dropped();
+        Element status = separator();
+        if (dropped > 0) {
+            status = text(fmt::format(" {} events dropped ", dropped)) |
+                     color(Color::Red);
         }
-        if (msgs_comp.size() > 0) {
-            msgs_comp.back() |= focus;
+        else if (m_show_logs) {
+            status = text(" Logs, F2 goes back to the messages ") |
+                     color(Color::GrayDark);
+        }
+        else if (m_scroll > 0) {
+            status = text(fmt::format(" {} newer messages ", m_scroll)) |
+                     color(Color::GrayDark);
         }
 
         // Return ui
+        auto content = m_show_logs
+                           ? render_logs(history_height)
+                           : render_history(history_width, history_height);
         return vbox({
-                   vbox(std::move(msgs_comp)) | flex | frame,
-                   separator(),
+                   std::move(content) | flex,
+                   status,
                    hbox(text(" Message : "), m_input_component->Render()),
                }) |
                borderHeavy;
     });
 }
 
+Frontend::~Frontend() {
+    // The flusher outlives the frontend
+    Logger::global().set_on_flush({});
+}
+
 bool Frontend::on_event(const ftxui::Event& event) {
-    if (event == ftxui::Event::Escape) {
+    if (event == ftxui::Event::Custom) {
+        drain_backend_events();
+        return false;
+    }
+    else if (event == ftxui::Event::F2) {
+        m_show_logs = !m_show_logs;
+        return true;
+    }
+    else if (event == ftxui::Event::Escape) {
         m_screen.ExitLoopClosure()();
         return true;
     }
     else if (event == ftxui::Event::Return) {
+        constexpr std::string_view send_file_command = "/sendfile ";
+        if (m_input_message.starts_with(send_file_command)) {
+            auto path = m_input_message.substr(send_file_command.size());
+            EventManager::send(FrontendEvent{ SendFile{ std::move(path) } });
+            m_input_message = "";
+            return false;
+        }
         EventManager::send(FrontendEvent{ SendMessage{ m_input_message } });
-        auto current_epoch = std::time(nullptr);
-        m_history.emplace_back(
-            m_client_name,
-            std::move(m_input_message),
-            *std::localtime(&current_epoch),
-            true
+        m_history_ref.append(
+            std::time(nullptr), true, m_client_name, m_input_message
         );
+        m_history_size = m_history_ref.size();
         m_input_message = "";
+        // Sending a message jumps back to the latest messages
+        m_scroll = 0;
         return false;
     }
+    else if (event == ftxui::Event::PageUp) {
+        scroll_by(std::max<std::ptrdiff_t>(m_visible_count - 1, 1));
+        return true;
+    }
+    else if (event == ftxui::Event::PageDown) {
+        scroll_by(-std::max<std::ptrdiff_t>(m_visible_count - 1, 1));
+        return true;
+    }
+    else if (event == ftxui::Event::ArrowUp) {
+        scroll_by(1);
+        return true;
+    }
+    else if (event == ftxui::Event::ArrowDown) {
+        scroll_by(-1);
+        return true;
+    }
+    else if (event.is_mouse()) {
+        // Event::mouse() is not const
+        auto mouse_event = event;
+        const auto& mouse = mouse_event.mouse();
+        if (mouse.button == Mouse::WheelUp) {
+            scroll_by(1);
+            return true;
+        }
+        if (mouse.button == Mouse::WheelDown) {
+            scroll_by(-1);
+            return true;
+        }
+    }
     return false;
 }
 
-void Frontend::on_event(const BackendEvent& event) {
-    event.match(
-        [this](const ReceiveMessage& sm) {
-            auto current_epoch = std::time(nullptr);
-            m_history.emplace_back(
-                sm.from, sm.message, *std::localtime(&current_epoch), false
-            );
+void Frontend::scroll_by(std::ptrdiff_t count) {
+    const auto max_scroll =
+        std::max<std::ptrdiff_t>(std::ptrdiff_t(m_history_size) - 1, 0);
+    const auto scroll = std::ptrdiff_t(m_scroll) + count;
+    m_scroll = std::size_t(std::clamp<std::ptrdiff_t>(scroll, 0, max_scroll));
+}
+
+const Frontend::MsgLayout& Frontend::layout_of(std::size_t index, int width) {
+    auto it = m_layouts.find(index);
+    if (it == m_layouts.end()) {
+        const HistoryRecord msg = m_history_ref[index];
+        // Name line + wrapped content + empty separator line
+        const int height = 2 + wrapped_line_count(msg.content, width);
+        it = m_layouts.emplace(index, MsgLayout{ render_msg(msg), height })
+                 .first;
+    }
+    return it->second;
+}
+
+Element Frontend::render_history(int width, int height) {
+    // Cached layouts depend on the width, a resize invalidates them
+    if (width != m_layout_width) {
+        m_layouts.clear();
+        m_layout_width = width;
+    }
+
+    // Walk backwards from the newest visible message until the view is full
+    Elements visible;
+    std::unordered_map<std::size_t, MsgLayout> kept;
+    int used_height = 0;
+    const std::size_t count = m_history_size;
+    for (std::size_t i = count - std::min(m_scroll, count); i-- > 0;) {
+        const auto& layout = layout_of(i, width);
+        if (used_height + layout.height > height && !visible.empty()) {
+            break;
+        }
+        used_height += layout.height;
+        visible.push_back(layout.element);
+        kept.emplace(i, layout);
+    }
+    m_visible_count = visible.size();
+    // Only the visible layouts stay cached
+    m_layouts = std::move(kept);
+
+    std::ranges::reverse(visible);
+    visible.insert(visible.begin(), filler());
+    return vbox(std::move(visible));
+}
+
+Element Frontend::render_logs(int height) {
+    Elements lines;
+    for (const auto& line :
+         Logger::global().recent(std::size_t(std::max(height, 0)))) {
+        lines.push_back(render_log_line(line));
+    }
+    lines.insert(lines.begin(), filler());
+    return vbox(std::move(lines));
+}
+
+void Frontend::on_event(const BackendEvent& /*event*/) {
+    // The history recorder already stored the event, this only wakes the UI
+    // up. Never blocks the network thread: when the UI falls behind, the
+    // wakeup is dropped and accounted for by the queue
+    m_backend_events.try_push(std::chrono::steady_clock::now());
+    request_redraw();
+}
+
+void Frontend::request_redraw() {
+    // Explicit redraw trigger, at most one pending at a time
+    if (!m_wakeup_pending.exchange(true, std::memory_order_acq_rel)) {
+        m_screen.PostEvent(ftxui::Event::Custom);
+    }
+}
+
+void Frontend::drain_backend_events() {
+    m_wakeup_pending.store(false, std::memory_order_release);
+
+    const auto now = std::chrono::steady_clock::now();
+    const auto count = m_backend_events.drain(
+        [now](std::chrono::steady_clock::time_point queued_at) {
+            Metrics::global().dispatch_ns.record(now - queued_at);
         },
-        [](const auto&) {}
+        max_events_per_frame
     );
-    // Explicit redraw trigger
-    m_screen.PostEvent(ftxui::Event::Custom);
+
+    // Keep the view still while scrolled back
+    const auto history_size = m_history_ref.size();
+    if (m_scroll > 0) {
+        m_scroll += history_size - m_history_size;
+    }
+    m_history_size = history_size;
+
+    // Leave the rest of a burst for the next frame
+    if (count == max_events_per_frame &&
+        !m_wakeup_pending.exchange(true, std::memory_order_acq_rel)) {
+        m_screen.PostEvent(ftxui::Event::Custom);
+    }
 }
 
 void Frontend::start() {
@@ -4,25 +4,25 @@
 #include "ftxui/component/screen_interactive.hpp"
 
 #include <ctime>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <fmt/chrono.h>
 #include <string>
+#include <unordered_map>
 
 #include "events.hpp"
+#include "logger.hpp"
+#include "message_log.hpp"
+#include "mpsc_queue.hpp"
 
 namespace peppe {
 
-struct Msg {
-    std::string username;
-    std::string content;
-    std::tm time;
-    bool is_me = false;
-};
-
 class Frontend : public EventListener<Frontend, BackendEvent> {
 
 public:
     // Ctor
-    Frontend(std::string&& name);
+    Frontend(std::string&& name, MessageLog& history);
     // Copy
     Frontend(Frontend const&) = delete;
     Frontend& operator=(Frontend const&) = delete;
@@ -30,18 +30,62 @@ public:
     Frontend(Frontend&&) = delete;
     Frontend& operator=(Frontend&&) = delete;
     // Dtor
-    ~Frontend() = default;
+    ~Frontend();
 
     bool on_event(const ftxui::Event& event);
 
+    // Called from the network threads, only queues the event
     void on_event(const BackendEvent& event) override;
 
     void start();
 
 private:
+    static constexpr std::size_t backend_queue_capacity = 8192;
+    static constexpr std::size_t max_events_per_frame = 1024;
+
+    // Borders, input line and status line around the history
+    static constexpr int history_margin_x = 3;
+    static constexpr int history_margin_y = 4;
+
+    // Rendered message and its height in rows for the current width
+    struct MsgLayout {
+        ftxui::Element element;
+        int height = 0;
+    };
+
+    // Shows the messages appended to the history since the last frame
+    void drain_backend_events();
+    // Can be called from any thread
+    void request_redraw();
+
+    void scroll_by(std::ptrdiff_t count);
+
+    // Builds elements for the visible messages only
+    ftxui::Element render_history(int width, int height);
+    const MsgLayout& layout_of(std::size_t index, int width);
+    // Latest diagnostics instead of the history (F2)
+    static ftxui::Element render_logs(int height);
+
     std::string m_input_message;
     std::string m_client_name;
-    std::vector<Msg> m_history = {};
+    // Sent and received messages, persisted on disk. Received ones are
+    // appended by the network threads, see HistoryRecorder.
+    MessageLog& m_history_ref;
+    // Messages shown, newer ones appear on the next frame
+    std::size_t m_history_size = 0;
+    // Layouts of the messages visible on the last frame, by history index
+    std::unordered_map<std::size_t, MsgLayout> m_layouts;
+    int m_layout_width = -1;
+    // Number of messages hidden below the view (0 follows the latest one)
+    std::size_t m_scroll = 0;
+    std::size_t m_visible_count = 0;
+    bool m_show_logs = false;
+    // Time every backend event was queued at, the events themselves are
+    // already in the history
+    MpscQueue<std::chrono::steady_clock::time_point> m_backend_events{
+        backend_queue_capacity
+    };
+    std::atomic<bool> m_wakeup_pending = false;
     ftxui::Component m_input_component;
     ftxui::Component m_component;
     ftxui::Component m_renderer;
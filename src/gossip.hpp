@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace peppe {
+
+struct GossipConfig {
+    // Number of peers a received message is relayed to. Messages written
+    // locally are sent to every connected peer.
+    std::size_t fanout = 3;
+    // Hops a message can travel, 1 disables relaying
+    std::uint8_t ttl = 6;
+    // Message ids remembered by the duplicate filter
+    std::size_t cache_size = 16 * 1024;
+};
+
+struct GossipStats {
+    std::atomic<std::uint64_t> originated = 0;
+    // Relayed messages received, duplicates included
+    std::atomic<std::uint64_t> received = 0;
+    std::atomic<std::uint64_t> duplicates = 0;
+    // Frames queued when relaying
+    std::atomic<std::uint64_t> forwarded = 0;
+
+    // Copies received for every distinct message
+    [[nodiscard]] double amplification() const {
+        const auto total = received.load(std::memory_order_relaxed);
+        const auto unique =
+            total - duplicates.load(std::memory_order_relaxed);
+        return (unique == 0) ? 0.0 : double(total) / double(unique);
+    }
+};
+
+// splitmix64 finalizer
+[[nodiscard]] constexpr std::uint64_t mix64(std::uint64_t value) {
+    value = (value ^ (value >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27U)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31U);
+}
+
+// Exact set of the last 'capacity' message ids: a ring holds them in
+// arrival order, the oldest id is forgotten when a new one is inserted in a
+// full ring. A copy arriving after 'capacity' newer messages is delivered
+// again, a message is never dropped by mistake.
+// The ids are looked up in an open addressing table at most half full,
+// allocated once: inserting never touches the heap.
+class DuplicateFilter {
+public:
+    // Ctor
+    explicit DuplicateFilter(std::size_t capacity)
+        : m_ring(std::max<std::size_t>(capacity, 1))
+        , m_slots(std::bit_ceil(2 * m_ring.size()))
+        , m_mask(m_slots.size() - 1) {}
+
+    // Returns false if the id was already inserted
+    bool insert(std::uint64_t id) {
+        auto index = find(id);
+        if (m_slots[index].used) {
+            return false;
+        }
+        if (m_size == m_ring.size()) {
+            erase(m_ring[m_next]);
+            // Erasing may have moved the free slot
+            index = find(id);
+        }
+        else {
+            ++m_size;
+        }
+        m_slots[index] = Slot{ .id = id, .used = true };
+        m_ring[m_next] = id;
+        m_next = (m_next + 1) % m_ring.size();
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::uint64_t id = 0;
+        bool used = false;
+    };
+
+    [[nodiscard]] std::size_t home(std::uint64_t id) const {
+        return std::size_t(mix64(id)) & m_mask;
+    }
+
+    // Slot holding 'id', or the free slot ending its probe sequence
+    [[nodiscard]] std::size_t find(std::uint64_t id) const {
+        auto index = home(id);
+        while (m_slots[index].used && m_slots[index].id != id) {
+            index = (index + 1) & m_mask;
+        }
+        return index;
+    }
+
+    // Linear probing without tombstones: the following entries of the
+    // cluster are shifted back into the hole when their probe sequence
+    // crosses it
+    void erase(std::uint64_t id) {
+        auto hole = find(id);
+        if (!m_slots[hole].used) {
+            return;
+        }
+        m_slots[hole].used = false;
+        for (auto index = (hole + 1) & m_mask; m_slots[index].used;
+             index = (index + 1) & m_mask) {
+            const auto distance = (index - home(m_slots[index].id)) & m_mask;
+            if (distance >= ((index - hole) & m_mask)) {
+                m_slots[hole] = m_slots[index];
+                m_slots[index].used = false;
+                hole = index;
+            }
+        }
+    }
+
+    std::vector<std::uint64_t> m_ring;
+    std::size_t m_next = 0;
+    std::size_t m_size = 0;
+    std::vector<Slot> m_slots;
+    std::size_t m_mask;
+};
+
+// Epidemic dissemination state shared by every session: every text frame
+// carries a network-wide unique id, a node delivers and relays a message
+// the first time it sees its id and drops the following copies.
+class Gossip {
+public:
+    // Ctor
+    Gossip()
+        : m_node_id(std::random_device{}() |
+                    (std::uint64_t(std::random_device{}()) << 32U)) {}
+    // Copy
+    Gossip(Gossip const&) = delete;
+    Gossip& operator=(Gossip const&) = delete;
+    // Move
+    Gossip(Gossip&&) = delete;
+    Gossip& operator=(Gossip&&) = delete;
+    // Dtor
+    ~Gossip() = default;
+
+    void set_config(const GossipConfig& config) {
+        std::lock_guard lock(m_mutex);
+        m_config = config;
+        m_filter = DuplicateFilter(config.cache_size);
+    }
+
+    [[nodiscard]] GossipConfig config() const {
+        std::lock_guard lock(m_mutex);
+        return m_config;
+    }
+
+    [[nodiscard]] std::uint64_t node_id() const { return m_node_id; }
+
+    // Id of a message written locally. mix64 is a bijection, so ids are
+    // unique per node and collide across nodes only if node ids do.
+    [[nodiscard]] std::uint64_t next_id() {
+        const auto counter =
+            m_counter.fetch_add(1, std::memory_order_relaxed);
+        const auto id = mix64(m_node_id + counter);
+        std::lock_guard lock(m_mutex);
+        m_filter.insert(id);
+        m_stats.originated.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    // Returns true the first time a received message id is seen
+    [[nodiscard]] bool first_seen(std::uint64_t id) {
+        m_stats.received.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard lock(m_mutex);
+        if (!m_filter.insert(id)) {
+            m_stats.duplicates.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    void add_forwarded(std::size_t frames) {
+        m_stats.forwarded.fetch_add(frames, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] const GossipStats& stats() const { return m_stats; }
+
+private:
+    const std::uint64_t m_node_id;
+    std::atomic<std::uint64_t> m_counter = 0;
+    mutable std::mutex m_mutex;
+    GossipConfig m_config;
+    DuplicateFilter m_filter{ m_config.cache_size };
+    GossipStats m_stats;
+};
+
+} // namespace peppe
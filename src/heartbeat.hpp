@@ -0,0 +1,43 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+
+namespace peppe {
+
+struct HeartbeatConfig {
+    // Time between two pings, zero disables heartbeats
+    std::chrono::milliseconds interval = std::chrono::seconds(5);
+    // Unanswered pings after which the peer is considered dead
+    std::size_t max_missed = 3;
+};
+
+// Smoothed round trip time (RFC 6298): every sample moves the estimate by
+// an eighth of the difference, the variation is tracked the same way with
+// a quarter.
+class RttEstimator {
+public:
+    using duration = std::chrono::microseconds;
+
+    void add_sample(duration sample) {
+        if (!m_srtt.has_value()) {
+            m_srtt = sample;
+            m_rttvar = sample / 2;
+            return;
+        }
+        const auto error = (sample > *m_srtt) ? sample - *m_srtt
+                                              : *m_srtt - sample;
+        m_rttvar += (error - m_rttvar) / 4;
+        *m_srtt += (sample - *m_srtt) / 8;
+    }
+
+    [[nodiscard]] std::optional<duration> srtt() const { return m_srtt; }
+    [[nodiscard]] duration rttvar() const { return m_rttvar; }
+
+private:
+    std::optional<duration> m_srtt;
+    duration m_rttvar{ 0 };
+};
+
+} // namespace peppe
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "chat_message.hpp"
+#include "events.hpp"
+#include "message_log.hpp"
+
+#include <fmt/core.h>
+
+#include <ctime>
+
+namespace peppe {
+
+// Appends what the node receives to the history, from the network thread
+// the event is sent on. Nothing goes through the UI queue, which drops
+// events when the UI falls behind: a headless node keeps its history too.
+// Must be constructed before the listeners reading the history, it is then
+// called first.
+class HistoryRecorder : public EventListener<HistoryRecorder, BackendEvent> {
+public:
+    // Ctor
+    explicit HistoryRecorder(MessageLog& history)
+        : m_history_ref(history) {}
+    // Copy
+    HistoryRecorder(HistoryRecorder const&) = delete;
+    HistoryRecorder& operator=(HistoryRecorder const&) = delete;
+    // Move
+    HistoryRecorder(HistoryRecorder&&) = delete;
+    HistoryRecorder& operator=(HistoryRecorder&&) = delete;
+    // Dtor
+    ~HistoryRecorder() = default;
+
+    void on_event(const BackendEvent& event) override {
+        const auto current_time = std::time(nullptr);
+        event.match(
+            [this, current_time](const ReceiveMessage& received) {
+                const auto& message = *received.message;
+                for (const auto text : message.texts()) {
+                    m_history_ref.append(
+                        current_time, false, message.sender(), text
+                    );
+                }
+            },
+            [this, current_time](const ReceiveFile& file) {
+                m_history_ref.append(
+                    current_time,
+                    false,
+                    file.from,
+                    fmt::format("Sent a file, saved as '{}'", file.path)
+                );
+            },
+            [](const auto&) {}
+        );
+    }
+
+private:
+    MessageLog& m_history_ref;
+};
+
+} // namespace peppe
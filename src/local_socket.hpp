@@ -0,0 +1,52 @@
+#pragma once
+
+#include "logger.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace peppe {
+
+// A socket file left by a previous run would make bind() fail. It is only
+// removed if nothing else than a socket lives at 'path' and nobody accepts
+// connections on it anymore. Returns false if 'path' must be left alone.
+[[nodiscard]] inline bool remove_stale_socket(const std::string& path) {
+    struct stat info {};
+    if (::lstat(path.c_str(), &info) != 0) {
+        return errno == ENOENT;
+    }
+    if (!S_ISSOCK(info.st_mode)) {
+        log_error("'{}' exists and isn't a socket", path);
+        return false;
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.data(), path.size());
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    const bool live =
+        ::connect(
+            fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)
+        ) == 0 ||
+        errno != ECONNREFUSED;
+    ::close(fd);
+    if (live) {
+        log_error("'{}' is in use by another process", path);
+        return false;
+    }
+    return ::unlink(path.c_str()) == 0 || errno == ENOENT;
+}
+
+} // namespace peppe
@@ -0,0 +1,173 @@
+#include "logger.hpp"
+
+#include <fmt/chrono.h>
+
+#include <algorithm>
+#include <ctime>
+
+namespace peppe {
+
+namespace {
+
+void write_line(std::FILE* file, const LogLine& line) {
+    const auto epoch = std::chrono::system_clock::to_time_t(line.time);
+    std::tm time{};
+    localtime_r(&epoch, &time);
+    const auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            line.time.time_since_epoch()
+                        )
+                            .count() %
+                        1000;
+    fmt::print(
+        file,
+        "{:%Y-%m-%d %H:%M:%S}.{:03} {:<5} {}\n",
+        time,
+        millis,
+        to_string(line.level),
+        line.text
+    );
+}
+
+} // namespace
+
+Logger::~Logger() {
+    if (m_flusher.joinable()) {
+        m_flusher.request_stop();
+        m_flusher.join();
+    }
+    if (m_file != nullptr) {
+        std::fclose(m_file);
+    }
+}
+
+Logger& Logger::global() {
+    static Logger instance;
+    return instance;
+}
+
+void Logger::start(const LoggerConfig& config) {
+    if (m_flusher.joinable()) {
+        return;
+    }
+    if (!config.file.empty()) {
+        m_file = std::fopen(config.file.c_str(), "a");
+        if (m_file == nullptr) {
+            // The UI doesn't own the terminal yet
+            fmt::print(stderr, "Can't open log file '{}'\n", config.file);
+        }
+    }
+    m_print_stderr = config.print_stderr;
+    m_flusher = std::jthread([this](std::stop_token stop) { run(stop); });
+}
+
+std::vector<LogLine> Logger::recent(std::size_t count) const {
+    std::lock_guard lock(m_recent_mutex);
+    const auto first = m_recent.size() - std::min(count, m_recent.size());
+    return { m_recent.begin() + std::ptrdiff_t(first), m_recent.end() };
+}
+
+void Logger::set_on_flush(std::function<void()> on_flush) {
+    std::lock_guard lock(m_on_flush_mutex);
+    m_on_flush = std::move(on_flush);
+}
+
+LogBuffer& Logger::thread_buffer() {
+    // Closed when the thread exits, the flusher frees it once drained
+    struct Owner {
+        std::shared_ptr<LogBuffer> buffer;
+
+        ~Owner() { buffer->close(); }
+    };
+    thread_local const Owner owner{ add_buffer() };
+    return *owner.buffer;
+}
+
+std::shared_ptr<LogBuffer> Logger::add_buffer() {
+    auto buffer = std::make_shared<LogBuffer>(buffer_capacity);
+    std::lock_guard lock(m_buffers_mutex);
+    m_buffers.push_back(buffer);
+    return buffer;
+}
+
+void Logger::run(std::stop_token stop) {
+    while (!stop.stop_requested()) {
+        flush();
+        std::unique_lock lock(m_wakeup_mutex);
+        m_wakeup.wait_for(lock, stop, flush_interval, [] { return false; });
+    }
+    // Records logged until the end
+    flush();
+}
+
+void Logger::flush() {
+    {
+        std::lock_guard lock(m_buffers_mutex);
+        m_draining = m_buffers;
+        // Buffers of exited threads are drained a last time below
+        std::erase_if(m_buffers, [](const auto& buffer) {
+            return buffer->closed();
+        });
+    }
+
+    std::uint64_t dropped = 0;
+    for (const auto& buffer : m_draining) {
+        buffer->drain([this](const LogEntry& record, const std::byte* args) {
+            LogLine line{
+                .time = std::chrono::system_clock::time_point(
+                    std::chrono::duration_cast<
+                        std::chrono::system_clock::duration>(
+                        std::chrono::nanoseconds(record.time_ns)
+                    )
+                ),
+                .level = record.level,
+                .text = {},
+            };
+            record.format(record.format_string, args, line.text);
+            m_lines.push_back(std::move(line));
+        });
+        dropped += buffer->take_dropped();
+    }
+    m_draining.clear();
+    if (dropped > 0) {
+        m_lines.push_back(LogLine{
+            .time = std::chrono::system_clock::now(),
+            .level = LogLevel::Warn,
+            .text = fmt::format("{} log records dropped", dropped),
+        });
+    }
+    if (m_lines.empty()) {
+        return;
+    }
+
+    // Threads are drained one after the other
+    std::ranges::stable_sort(m_lines, {}, &LogLine::time);
+    for (const auto& line : m_lines) {
+        if (m_file != nullptr) {
+            write_line(m_file, line);
+        }
+        if (m_print_stderr) {
+            write_line(stderr, line);
+        }
+    }
+    if (m_file != nullptr) {
+        std::fflush(m_file);
+    }
+
+    {
+        std::lock_guard lock(m_recent_mutex);
+        for (auto& line : m_lines) {
+            m_recent.push_back(std::move(line));
+        }
+        while (m_recent.size() > max_recent) {
+            m_recent.pop_front();
+        }
+    }
+    m_lines.clear();
+
+    std::lock_guard lock(m_on_flush_mutex);
+    if (m_on_flush) {
+        m_on_flush();
+    }
+}
+
+} // namespace peppe
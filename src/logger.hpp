@@ -0,0 +1,405 @@
+#pragma once
+
+#include <fmt/core.h>
+
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace peppe {
+
+enum class LogLevel : std::uint8_t {
+    Debug,
+    Info,
+    Warn,
+    Error,
+};
+
+// Lower levels are compiled out. Debug builds keep every level, release
+// builds start at Info, PEPPERONI_LOG_LEVEL (0 = Debug .. 3 = Error)
+// overrides both.
+#if defined(PEPPERONI_LOG_LEVEL)
+inline constexpr auto min_log_level = LogLevel(PEPPERONI_LOG_LEVEL);
+#elif defined(DEBUG)
+inline constexpr auto min_log_level = LogLevel::Debug;
+#else
+inline constexpr auto min_log_level = LogLevel::Info;
+#endif
+
+[[nodiscard]] constexpr std::string_view to_string(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: {
+            return "debug";
+        }
+        case LogLevel::Info: {
+            return "info";
+        }
+        case LogLevel::Warn: {
+            return "warn";
+        }
+        case LogLevel::Error: {
+            return "error";
+        }
+    }
+    return "";
+}
+
+struct LoggerConfig {
+    // Lines are appended to this file (empty = disabled)
+    std::string file;
+    // Also print the lines on stderr, when no UI owns the terminal
+    bool print_stderr = false;
+};
+
+// Formatted line, as kept for the UI
+struct LogLine {
+    std::chrono::system_clock::time_point time;
+    LogLevel level = LogLevel::Info;
+    std::string text;
+};
+
+// Strings are copied into the record, other arguments must be arithmetic
+template<typename T>
+concept LogString = std::convertible_to<const T&, std::string_view>;
+template<typename T>
+concept LogArgument = LogString<T> || std::is_arithmetic_v<T>;
+
+// Header of a record, its arguments follow it in the buffer
+struct LogEntry {
+    using FormatFn =
+        void (*)(fmt::string_view, const std::byte*, std::string&);
+
+    // Bytes up to the next record, arguments included
+    std::uint32_t size = 0;
+    LogLevel level = LogLevel::Info;
+    // Nanoseconds since the epoch of the system clock
+    std::int64_t time_ns = 0;
+    // nullptr for the padding before the buffer wraps around
+    FormatFn format = nullptr;
+    // Format strings are literals, they outlive the record
+    fmt::string_view format_string;
+};
+
+namespace detail {
+
+template<typename T>
+struct LogArgCodec {
+    using Decoded = T;
+
+    static std::size_t size(const T&) { return sizeof(T); }
+
+    static std::byte* write(std::byte* out, const T& value) {
+        std::memcpy(out, &value, sizeof(T));
+        return out + sizeof(T);
+    }
+
+    static Decoded read(const std::byte*& in) {
+        T value;
+        std::memcpy(&value, in, sizeof(T));
+        in += sizeof(T);
+        return value;
+    }
+};
+
+template<LogString T>
+struct LogArgCodec<T> {
+    // Points into the buffer, valid while the record is formatted
+    using Decoded = std::string_view;
+
+    static std::size_t size(const T& value) {
+        return sizeof(std::uint32_t) + std::string_view(value).size();
+    }
+
+    static std::byte* write(std::byte* out, const T& value) {
+        const std::string_view str(value);
+        const auto len = std::uint32_t(str.size());
+        std::memcpy(out, &len, sizeof(len));
+        std::memcpy(out + sizeof(len), str.data(), str.size());
+        return out + sizeof(len) + str.size();
+    }
+
+    static Decoded read(const std::byte*& in) {
+        std::uint32_t len = 0;
+        std::memcpy(&len, in, sizeof(len));
+        const auto* data = reinterpret_cast<const char*>(in + sizeof(len));
+        in += sizeof(len) + len;
+        return { data, len };
+    }
+};
+
+// Instantiated per call site signature, run by the flusher
+template<typename... Args>
+void format_record(
+    fmt::string_view format,
+    [[maybe_unused]] const std::byte* in,
+    std::string& out
+) {
+    // Braced initialization reads the arguments in order
+    const std::tuple<typename LogArgCodec<Args>::Decoded...> args{
+        LogArgCodec<Args>::read(in)...
+    };
+    std::apply(
+        [format, &out](const auto&... values) {
+            fmt::vformat_to(
+                std::back_inserter(out),
+                format,
+                fmt::make_format_args(values...)
+            );
+        },
+        args
+    );
+}
+
+} // namespace detail
+
+// Records of a single thread (Lamport's single producer/single consumer
+// ring). Records are never split: one that doesn't fit before the end
+// starts over at the beginning, after a padding record.
+class LogBuffer {
+public:
+    // Ctor (the capacity is a power of two)
+    explicit LogBuffer(std::size_t capacity)
+        : m_capacity(capacity)
+        , m_data(std::make_unique<std::byte[]>(capacity)) {}
+    // Copy
+    LogBuffer(LogBuffer const&) = delete;
+    LogBuffer& operator=(LogBuffer const&) = delete;
+    // Move
+    LogBuffer(LogBuffer&&) = delete;
+    LogBuffer& operator=(LogBuffer&&) = delete;
+    // Dtor
+    ~LogBuffer() = default;
+
+    // Producer only. Space for a record of 'size' bytes (a multiple of
+    // alignof(LogEntry)), nullptr when the buffer is full or too small.
+    [[nodiscard]] std::byte* reserve(std::size_t size) {
+        const auto write = m_write.load(std::memory_order_relaxed);
+        const auto read = m_read.load(std::memory_order_acquire);
+        const auto offset = write & (m_capacity - 1);
+        const auto contiguous = m_capacity - offset;
+        const auto skip = (size > contiguous) ? contiguous : 0;
+        if (skip + size > m_capacity - (write - read)) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        if (skip >= sizeof(LogEntry)) {
+            LogEntry padding;
+            padding.size = std::uint32_t(skip);
+            std::memcpy(m_data.get() + offset, &padding, sizeof(padding));
+        }
+        m_reserved = write + skip + size;
+        return m_data.get() + ((write + skip) & (m_capacity - 1));
+    }
+
+    // Producer only, publishes the reserved record
+    void commit() { m_write.store(m_reserved, std::memory_order_release); }
+
+    // Consumer only. Calls 'func(const LogEntry&, const std::byte* args)'
+    // for every published record.
+    template<typename F>
+    void drain(F&& func) {
+        auto read = m_read.load(std::memory_order_relaxed);
+        const auto write = m_write.load(std::memory_order_acquire);
+        while (read != write) {
+            const auto offset = read & (m_capacity - 1);
+            const auto contiguous = m_capacity - offset;
+            if (contiguous < sizeof(LogEntry)) {
+                // Too short for a header, the producer skipped it too
+                read += contiguous;
+                continue;
+            }
+            LogEntry record;
+            std::memcpy(&record, m_data.get() + offset, sizeof(record));
+            if (record.format != nullptr) {
+                func(record, m_data.get() + offset + sizeof(record));
+            }
+            read += record.size;
+        }
+        m_read.store(read, std::memory_order_release);
+    }
+
+    // Records dropped since the last call
+    [[nodiscard]] std::uint64_t take_dropped() {
+        return m_dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    // Set when the owning thread exits
+    void close() { m_closed.store(true, std::memory_order_release); }
+    [[nodiscard]] bool closed() const {
+        return m_closed.load(std::memory_order_acquire);
+    }
+
+private:
+    const std::size_t m_capacity;
+    std::unique_ptr<std::byte[]> m_data;
+    // The producer and the consumer live on different cache lines
+    alignas(64) std::atomic<std::size_t> m_write = 0;
+    std::size_t m_reserved = 0;
+    std::atomic<std::uint64_t> m_dropped = 0;
+    alignas(64) std::atomic<std::size_t> m_read = 0;
+    std::atomic<bool> m_closed = false;
+};
+
+// Diagnostics of the whole process. Logging neither locks nor formats on the
+// calling thread (past its first record, which registers its buffer): the
+// arguments are copied into a buffer owned by the thread, and a background
+// thread formats the records, writes them to the configured sinks and keeps
+// the latest ones for the UI's log panel.
+// A thread logging faster than the flusher drains loses records, they are
+// reported as a single line.
+class Logger {
+public:
+    // Bytes of records each thread can have pending
+    static constexpr std::size_t buffer_capacity = 64 * 1024;
+    // Lines kept for the UI
+    static constexpr std::size_t max_recent = 1024;
+    static constexpr auto flush_interval = std::chrono::milliseconds(50);
+
+    // Ctor
+    Logger() = default;
+    // Copy
+    Logger(Logger const&) = delete;
+    Logger& operator=(Logger const&) = delete;
+    // Move
+    Logger(Logger&&) = delete;
+    Logger& operator=(Logger&&) = delete;
+    // Dtor, flushes the pending records
+    ~Logger();
+
+    [[nodiscard]] static Logger& global();
+
+    // Opens the sinks and starts the flusher. Records logged before are
+    // kept until then.
+    void start(const LoggerConfig& config);
+
+    // Can be called from any thread
+    template<typename... Args>
+    void write(
+        LogLevel level,
+        fmt::format_string<Args...> format,
+        Args&&... args
+    ) {
+        static_assert(
+            (LogArgument<std::remove_cvref_t<Args>> && ...),
+            "log arguments must be strings or arithmetic values"
+        );
+        constexpr auto align = alignof(LogEntry);
+        const auto args_size =
+            (std::size_t(0) + ... +
+             detail::LogArgCodec<std::remove_cvref_t<Args>>::size(args));
+        const auto size =
+            (sizeof(LogEntry) + args_size + align - 1) / align * align;
+
+        const auto now = std::chrono::system_clock::now().time_since_epoch();
+        auto& buffer = thread_buffer();
+        auto* out = buffer.reserve(size);
+        if (out == nullptr) {
+            return;
+        }
+        const LogEntry record{
+            .size = std::uint32_t(size),
+            .level = level,
+            .time_ns =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now)
+                    .count(),
+            .format = &detail::format_record<std::remove_cvref_t<Args>...>,
+            .format_string = fmt::string_view(format),
+        };
+        std::memcpy(out, &record, sizeof(record));
+        out += sizeof(record);
+        ((out = detail::LogArgCodec<std::remove_cvref_t<Args>>::write(
+              out, args
+          )),
+         ...);
+        buffer.commit();
+    }
+
+    // Latest lines, oldest first
+    [[nodiscard]] std::vector<LogLine> recent(std::size_t count) const;
+
+    // Called by the flusher after new lines were kept, pass an empty
+    // function to unregister
+    void set_on_flush(std::function<void()> on_flush);
+
+private:
+    [[nodiscard]] LogBuffer& thread_buffer();
+    [[nodiscard]] std::shared_ptr<LogBuffer> add_buffer();
+
+    void run(std::stop_token stop);
+    void flush();
+
+    // Buffers of every thread that logged
+    std::mutex m_buffers_mutex;
+    std::vector<std::shared_ptr<LogBuffer>> m_buffers;
+    // Flusher only
+    std::vector<std::shared_ptr<LogBuffer>> m_draining;
+    std::vector<LogLine> m_lines;
+    std::FILE* m_file = nullptr;
+    bool m_print_stderr = false;
+
+    mutable std::mutex m_recent_mutex;
+    std::deque<LogLine> m_recent;
+
+    std::mutex m_on_flush_mutex;
+    std::function<void()> m_on_flush;
+
+    std::mutex m_wakeup_mutex;
+    std::condition_variable_any m_wakeup;
+    // Last, stopped before the rest is destroyed
+    std::jthread m_flusher;
+};
+
+template<typename... Args>
+void log_debug(fmt::format_string<Args...> format, Args&&... args) {
+    if constexpr (LogLevel::Debug >= min_log_level) {
+        Logger::global().write(
+            LogLevel::Debug, format, std::forward<Args>(args)...
+        );
+    }
+}
+
+template<typename... Args>
+void log_info(fmt::format_string<Args...> format, Args&&... args) {
+    if constexpr (LogLevel::Info >= min_log_level) {
+        Logger::global().write(
+            LogLevel::Info, format, std::forward<Args>(args)...
+        );
+    }
+}
+
+template<typename... Args>
+void log_warn(fmt::format_string<Args...> format, Args&&... args) {
+    if constexpr (LogLevel::Warn >= min_log_level) {
+        Logger::global().write(
+            LogLevel::Warn, format, std::forward<Args>(args)...
+        );
+    }
+}
+
+template<typename... Args>
+void log_error(fmt::format_string<Args...> format, Args&&... args) {
+    if constexpr (LogLevel::Error >= min_log_level) {
+        Logger::global().write(
+            LogLevel::Error, format, std::forward<Args>(args)...
+        );
+    }
+}
+
+} // namespace peppe
@@ -1,53 +1,115 @@
 #include "config.hpp"
 #include "events.hpp"
 #include "frontend.hpp"
+#include "history_recorder.hpp"
+#include "logger.hpp"
+#include "message_log.hpp"
 #include "peer_listener.hpp"
 
 #include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 void print_config(const peppe::Config& config) {
     fmt::print("name: '{}'\n", config.name);
     fmt::print("port: '{}'\n", config.port);
+    fmt::print("threads: '{}'\n", config.threads);
     fmt::print("initial_peers:\n");
     for (const auto& peer : config.peer_table) {
-        fmt::print("- ip/port: '{}:{}'\n", peer.address.to_string(), peer.port);
+        if (peer.is_local()) {
+            fmt::print("- path: '{}'\n", peer.local_path);
+        }
+        else {
+            fmt::print("- host/port: '{}:{}'\n", peer.host, peer.port);
+        }
     }
 }
 
+// Usage: PepperoniBin [--headless] [config.toml]
 int main(int argc, const char* argv[]) {
     using namespace peppe;
 
+    // Parse arguments
+    std::string_view config_path = "config.toml";
+    bool headless = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--headless") {
+            headless = true;
+        }
+        else {
+            config_path = arg;
+        }
+    }
+
     // Load config
-    auto config = Config::load_toml((argc < 2) ? "config.toml" : argv[1])
-                      .value_or(Config{});
+    auto config = Config::load_toml(config_path).value_or(Config{});
     print_config(config);
 
-    // Launch Frontend in a separate thread
-    const int num_threads_hint = int(std::thread::hardware_concurrency());
-    asio::io_context io_context(num_threads_hint);
-    auto frontend = Frontend(std::string(config.name));
-    std::jthread frontend_thread([&frontend] { frontend.start(); });
+    // Diagnostics go to the log panel, the terminal is only theirs headless
+    config.logger.print_stderr = headless;
+    Logger::global().start(config.logger);
+    if (headless && config.control_socket.empty()) {
+        log_warn("Running headless without a control socket, relay only");
+    }
+
+    // Launch Frontend in a separate thread, unless running headless
+    const unsigned num_threads =
+        (config.threads > 0)
+            ? config.threads
+            : std::max(1U, std::thread::hardware_concurrency());
+    asio::io_context io_context{ int(num_threads) };
+    // Received messages are stored by the network threads, headless too.
+    // The recorder is created first so the frontend is called after it.
+    MessageLog history(config.history);
+    HistoryRecorder history_recorder(history);
+    std::optional<Frontend> frontend;
+    std::jthread frontend_thread;
+    if (!headless) {
+        frontend.emplace(std::string(config.name), history);
+        frontend_thread = std::jthread([&frontend] { frontend->start(); });
+    }
 
     // Launch peer listener with an async runtime
     PeerListener peer_listener(io_context, std::move(config.peer_table));
     peer_listener.set_port(config.port);
+    peer_listener.set_unix_socket(config.unix_socket);
     peer_listener.set_client_name(config.name);
+    peer_listener.set_outbound_config(config.outbound);
+    peer_listener.set_batch_config(config.batch);
+    peer_listener.set_compression_config(config.compression);
+    peer_listener.set_gossip_config(config.gossip);
+    peer_listener.set_dial_config(config.dial);
+    peer_listener.set_discovery_config(config.discovery);
+    peer_listener.set_heartbeat_config(config.heartbeat);
+    peer_listener.set_file_transfer_config(config.files);
+    peer_listener.set_metrics_port(asio::ip::port_type(config.metrics_port));
+    peer_listener.set_control_socket(config.control_socket);
     co_spawn(io_context, peer_listener.listener(), detached);
 
     // Setup signal handlers and run async event loop
     asio::signal_set signals(io_context, SIGINT, SIGTERM);
     signals.async_wait([&](auto, auto) { io_context.stop(); });
+
+    // Run the event loop on the worker pool, the main thread being one of the
+    // workers
+    std::vector<std::jthread> workers;
+    workers.reserve(num_threads - 1);
+    for (unsigned i = 1; i < num_threads; ++i) {
+        workers.emplace_back([&io_context] { io_context.run(); });
+    }
     io_context.run();
 }
 
 //////////////////////////////////////////////////////////////////////
 
-// #include "peer_session.hpp"
+// #include "wire.hpp"
 // #include "utils.hpp"
 // #include <fmt/core.h>
 
 // int main() {
 //     uint32_t num = 0x11223344;
 //     fmt::print("0x{:0x}\n", num);
-//     fmt::print("0x{:0x}\n", peppe::reverse_bytes(num));
+//     fmt::print("0x{:0x}\n", peppe::byteswap(num));
 // }
\ No newline at end of file
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace peppe {
+
+// Storage of encoded frames, recycled instead of freed. The last owner of a
+// frame (a writer, on any thread) returns its buffer to the pool, and the
+// shared_ptr control blocks come from a pool resource too: encoding a frame
+// in steady state doesn't touch the heap.
+class FramePool {
+public:
+    using Buffer = std::vector<std::uint8_t>;
+
+    // Buffers kept for reuse
+    static constexpr std::size_t max_pooled = 1024;
+    // Larger buffers are freed, a single big frame mustn't stay pinned
+    static constexpr std::size_t max_pooled_capacity = 64 * 1024;
+
+    // Ctor
+    FramePool() { m_free.reserve(max_pooled); }
+    // Copy
+    FramePool(FramePool const&) = delete;
+    FramePool& operator=(FramePool const&) = delete;
+    // Move
+    FramePool(FramePool&&) = delete;
+    FramePool& operator=(FramePool&&) = delete;
+    // Dtor
+    ~FramePool() = default;
+
+    [[nodiscard]] static FramePool& global() {
+        static FramePool instance;
+        return instance;
+    }
+
+    // Frame of 'size' bytes written by 'encode(std::uint8_t* out)'
+    template<typename Encode>
+    [[nodiscard]] std::shared_ptr<const Buffer>
+    make(std::size_t size, Encode&& encode) {
+        auto buffer = acquire();
+        buffer->resize(size);
+        encode(buffer->data());
+        return std::shared_ptr<const Buffer>(
+            buffer.release(),
+            Recycler{ this },
+            std::pmr::polymorphic_allocator<std::byte>(&m_control_blocks)
+        );
+    }
+
+private:
+    struct Recycler {
+        FramePool* pool;
+
+        void operator()(const Buffer* buffer) const {
+            // The pool handed it out as mutable
+            pool->release(std::unique_ptr<Buffer>(const_cast<Buffer*>(buffer))
+            );
+        }
+    };
+
+    [[nodiscard]] std::unique_ptr<Buffer> acquire() {
+        std::lock_guard lock(m_mutex);
+        if (m_free.empty()) {
+            return std::make_unique<Buffer>();
+        }
+        auto buffer = std::move(m_free.back());
+        m_free.pop_back();
+        return buffer;
+    }
+
+    void release(std::unique_ptr<Buffer> buffer) {
+        if (buffer->capacity() > max_pooled_capacity) {
+            return;
+        }
+        buffer->clear();
+        std::lock_guard lock(m_mutex);
+        if (m_free.size() < max_pooled) {
+            m_free.push_back(std::move(buffer));
+        }
+    }
+
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Buffer>> m_free;
+    std::pmr::synchronized_pool_resource m_control_blocks;
+};
+
+// Memory of the asynchronous operations a loop keeps starting: a session's
+// reads, writes or timer waits. The blocks are kept once freed and handed
+// out again, an operation started in steady state doesn't touch the heap.
+// An operation may need a second block while its first one is in use, when
+// its completion goes through a strand.
+// Not thread safe: the operations sharing it must not be started
+// concurrently.
+class HandlerMemory {
+public:
+    static constexpr std::size_t max_blocks = 2;
+
+    // Ctor
+    HandlerMemory() = default;
+    // Copy
+    HandlerMemory(HandlerMemory const&) = delete;
+    HandlerMemory& operator=(HandlerMemory const&) = delete;
+    // Move
+    HandlerMemory(HandlerMemory&&) = delete;
+    HandlerMemory& operator=(HandlerMemory&&) = delete;
+    // Dtor
+    ~HandlerMemory() {
+        for (const auto& block : m_blocks) {
+            ::operator delete(block.data);
+        }
+    }
+
+    [[nodiscard]] void* allocate(std::size_t size) {
+        Block* spare = nullptr;
+        for (auto& block : m_blocks) {
+            if (block.in_use) {
+                continue;
+            }
+            if (block.size >= size) {
+                block.in_use = true;
+                return block.data;
+            }
+            spare = &block;
+        }
+        if (spare == nullptr) {
+            return ::operator new(size);
+        }
+        // Grows a block that is too small
+        void* data = ::operator new(size);
+        ::operator delete(spare->data);
+        spare->data = data;
+        spare->size = size;
+        spare->in_use = true;
+        return spare->data;
+    }
+
+    void deallocate(void* pointer) {
+        for (auto& block : m_blocks) {
+            if (block.data == pointer) {
+                block.in_use = false;
+                return;
+            }
+        }
+        ::operator delete(pointer);
+    }
+
+private:
+    struct Block {
+        void* data = nullptr;
+        std::size_t size = 0;
+        bool in_use = false;
+    };
+
+    std::array<Block, max_blocks> m_blocks;
+};
+
+// Allocator of the operations a handler bound to a HandlerMemory is passed
+// to, found by asio as the handler's associated allocator
+template<typename T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+    // Ctor
+    explicit HandlerAllocator(HandlerMemory& memory) noexcept
+        : m_memory(&memory) {}
+    template<typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept
+        : m_memory(other.m_memory) {}
+
+    [[nodiscard]] T* allocate(std::size_t count) {
+        return static_cast<T*>(m_memory->allocate(sizeof(T) * count));
+    }
+    void deallocate(T* pointer, std::size_t /*count*/) {
+        m_memory->deallocate(pointer);
+    }
+
+    template<typename U>
+    [[nodiscard]] bool operator==(const HandlerAllocator<U>& other
+    ) const noexcept {
+        return m_memory == other.m_memory;
+    }
+
+private:
+    template<typename U>
+    friend class HandlerAllocator;
+
+    HandlerMemory* m_memory;
+};
+
+// Completion handler whose operations are allocated from a HandlerMemory
+template<typename Handler>
+class MemoryHandler {
+public:
+    using allocator_type = HandlerAllocator<Handler>;
+
+    // Ctor
+    MemoryHandler(HandlerMemory& memory, Handler handler)
+        : m_memory(&memory)
+        , m_handler(std::move(handler)) {}
+
+    [[nodiscard]] allocator_type get_allocator() const noexcept {
+        return allocator_type(*m_memory);
+    }
+
+    template<typename... Args>
+    void operator()(Args&&... args) {
+        m_handler(std::forward<Args>(args)...);
+    }
+
+private:
+    HandlerMemory* m_memory;
+    Handler m_handler;
+};
+
+template<typename Handler>
+[[nodiscard]] MemoryHandler<std::decay_t<Handler>>
+bind_memory(HandlerMemory& memory, Handler&& handler) {
+    return { memory, std::forward<Handler>(handler) };
+}
+
+} // namespace peppe
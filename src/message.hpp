@@ -1,310 +1,471 @@
 #pragma once
 
 #include "asio/ip/address_v4.hpp"
-#include "fmt/base.h"
+#include "asio/ip/address_v6.hpp"
+#include <algorithm>
 #include <array>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
 #include <asio/experimental/as_tuple.hpp>
 #include <asio/experimental/awaitable_operators.hpp>
 #include <asio/ip/tcp.hpp>
-#include <asio/read.hpp>
 #include <asio/write.hpp>
 
 using asio::ip::tcp;
 
 #include "error.hpp"
+#include "memory.hpp"
 #include "utils.hpp"
+#include "wire.hpp"
 
 namespace peppe {
 
 constexpr auto use_nothrow_awaitable =
     asio::experimental::as_tuple(asio::use_awaitable);
 
+// Immutable encoded frame. A broadcast encodes the packet once and every
+// recipient's outbound queue holds a reference to the same bytes.
+using WireBuffer = std::shared_ptr<const std::vector<std::uint8_t>>;
+
 enum class MessageType : std::uint8_t {
     TextMessageType = 0,
     SetNameType = 1,
     PeerDiscoveryType = 2,
+    TextBatchType = 3,
+    CapabilitiesType = 4,
+    CompressedType = 5,
+    PingType = 6,
+    PongType = 7,
+    AnnounceType = 8,
+    FileOfferType = 9,
+    FileAcceptType = 10,
+    FileChunkType = 11,
+    FileAckType = 12,
+    FragmentType = 13,
+    FileDeclineType = 14,
 };
 
-struct TextMessage {
-    static constexpr auto msg_type = MessageType::TextMessageType;
-    // TODO: Size not needed
-    std::uint32_t size;
-    std::string text;
-
-    template<typename AsyncReadStream>
-    static asio::awaitable<TextMessage> read(AsyncReadStream& stream) {
-        TextMessage result;
-
-        // 1. Read 'size' from stream
-        auto [err1, len1] = co_await asio::async_read(
-            stream,
-            asio::buffer(&result.size, sizeof(std::uint32_t)),
-            use_nothrow_awaitable
-        );
-        // Convert from network endianess (big endian) to host
-        // endianess (little endian)
-        result.size = peppe::reverse_bytes(result.size);
-        if (err1) {
-            throw ConnectionClosed();
-        }
+// Every message declares its fields once in its 'schema', the wire codec is
+// generated from it (see wire.hpp). To add a message, declare it here and
+// add it to 'PacketMessages'.
+// Chat messages are decoded as views over the received frame, a single
+// ChatMessage is then built from them (see chat_message.hpp).
+
+// Identifies a message relayed through the network (see gossip.hpp)
+struct GossipHeader {
+    std::uint64_t id = 0;
+    // Remaining hops
+    std::uint8_t ttl = 0;
+    // Name of the peer that wrote the message
+    std::string_view origin;
+};
 
-        // 2. Read 'text' from stream
-        // Allocate necessary space for the 'text'
-        result.text.resize(result.size);
-        auto [err2, len2] = co_await asio::async_read(
-            stream,
-            asio::buffer(result.text.data(), result.size),
-            use_nothrow_awaitable
-        );
-        if (err2) {
-            throw ConnectionClosed();
-        }
+// [id: u64][ttl: u8][origin: String<u8>]
+struct GossipHeaderWire {
+    using value_type = GossipHeader;
 
-        co_return result;
+    static std::size_t size(const GossipHeader& header) {
+        return sizeof(header.id) + sizeof(header.ttl) +
+               StringView<std::uint8_t>::size(header.origin);
     }
 
-    template<typename SyncWriteStream>
-    void write(SyncWriteStream& stream) const {
-        auto net_size = peppe::reverse_bytes(size);
-        std::vector<asio::const_buffer> packet_data{
-            asio::buffer(&msg_type, sizeof(std::uint8_t)),
-            asio::buffer(&net_size, sizeof(std::uint32_t)),
-            asio::buffer(text.data(), size)
-        };
+    static std::uint8_t* encode(const GossipHeader& header, std::uint8_t* out) {
+        out = BigEndian<std::uint64_t>::encode(header.id, out);
+        out = BigEndian<std::uint8_t>::encode(header.ttl, out);
+        return StringView<std::uint8_t>::encode(header.origin, out);
+    }
 
-        asio::error_code err;
-        asio::write(stream, packet_data, err);
-        if (err) {
-            throw ConnectionClosed();
-        }
+    static bool decode(ByteReader& reader, GossipHeader& header) {
+        return BigEndian<std::uint64_t>::decode(reader, header.id) &&
+               BigEndian<std::uint8_t>::decode(reader, header.ttl) &&
+               StringView<std::uint8_t>::decode(reader, header.origin);
     }
 };
 
+struct TextMessage {
+    static constexpr auto msg_type = MessageType::TextMessageType;
+    GossipHeader gossip;
+    std::string_view text;
+
+    using schema = Schema<
+        Field<&TextMessage::gossip, GossipHeaderWire>,
+        Field<&TextMessage::text, StringView<std::uint32_t>>>;
+};
+
 struct SetName {
     static constexpr auto msg_type = MessageType::SetNameType;
-    std::uint8_t size;
     std::string name;
 
-    template<typename AsyncReadStream>
-    static asio::awaitable<SetName> read(AsyncReadStream& stream) {
-        SetName result;
+    using schema = Schema<Field<&SetName::name, String<std::uint8_t>>>;
+};
 
-        // 1. Read 'size' from stream
-        auto [err1, len1] = co_await asio::async_read(
-            stream,
-            asio::buffer(&result.size, sizeof(std::uint8_t)),
-            use_nothrow_awaitable
-        );
-        if (err1) {
-            throw ConnectionClosed();
-        }
+using Ipv4Bytes = asio::ip::address_v4::bytes_type;
+using Ipv6Bytes = asio::ip::address_v6::bytes_type;
+using Ipv4List = Vector<Raw<Ipv4Bytes>, std::uint8_t>;
+using Ipv6List = Vector<Raw<Ipv6Bytes>, std::uint8_t>;
 
-        // Convert from network endianess (big endian) to host
-        // endianess (little endian)
-        result.size = peppe::reverse_bytes(result.size);
-
-        // 2. Read 'name' from stream
-        // Allocate necessary space for the 'name'
-        result.name.resize(result.size);
-        auto [err2, len2] = co_await asio::async_read(
-            stream,
-            asio::buffer(result.name.data(), result.size),
-            use_nothrow_awaitable
-        );
-        if (err2) {
-            throw ConnectionClosed();
-        }
+struct PeerDiscovery {
+    static constexpr auto msg_type = MessageType::PeerDiscoveryType;
+    std::vector<Ipv4Bytes> ipv4_addresses;
+    std::vector<Ipv6Bytes> ipv6_addresses;
 
-        co_return result;
+    // Addresses bytes are already in network order
+    using schema = Schema<
+        Field<&PeerDiscovery::ipv4_addresses, Ipv4List>,
+        Field<&PeerDiscovery::ipv6_addresses, Ipv6List>>;
+};
+
+// Several text messages coalesced into a single frame
+struct TextBatch {
+    static constexpr auto msg_type = MessageType::TextBatchType;
+    GossipHeader gossip;
+    using TextList = VectorView<StringView<std::uint32_t>, std::uint16_t>;
+    TextList::value_type texts;
+
+    using schema = Schema<
+        Field<&TextBatch::gossip, GossipHeaderWire>,
+        Field<&TextBatch::texts, TextList>>;
+
+    // Frame of texts held in any sized range of string views, e.g. local
+    // texts or the texts of a received batch
+    template<typename Texts>
+    using TextsWire = Vector<StringView<std::uint32_t>, std::uint16_t, Texts>;
+
+    template<typename Texts>
+    static std::size_t
+    encoded_size(const GossipHeader& gossip, const Texts& texts) {
+        return sizeof(MessageType) + GossipHeaderWire::size(gossip) +
+               TextsWire<Texts>::size(texts);
+    }
+    template<typename Texts>
+    static void encode(
+        const GossipHeader& gossip,
+        const Texts& texts,
+        std::uint8_t* out
+    ) {
+        out = BigEndian<MessageType>::encode(msg_type, out);
+        out = GossipHeaderWire::encode(gossip, out);
+        TextsWire<Texts>::encode(texts, out);
     }
+};
 
-    template<typename SyncWriteStream>
-    void write(SyncWriteStream& stream) const {
-        auto net_size = peppe::reverse_bytes(size);
-        std::vector<asio::const_buffer> packet_data{
-            asio::buffer(&msg_type, sizeof(std::uint8_t)),
-            asio::buffer(&net_size, sizeof(std::uint8_t)),
-            asio::buffer(name.data(), size)
-        };
+// First frame sent on a connection, advertises optional protocol features
+struct Capabilities {
+    static constexpr auto msg_type = MessageType::CapabilitiesType;
+
+    enum Flags : std::uint32_t {
+        // Accepts 'Compressed' frames
+        StreamCompression = 1U << 0U,
+        // Reassembles 'Fragment' frames
+        Fragments = 1U << 1U,
+    };
+    std::uint32_t flags = 0;
+    // Gossip node id of the sender, stable for the lifetime of its process
+    std::uint64_t node_id = 0;
+
+    using schema = Schema<
+        Field<&Capabilities::flags, BigEndian<std::uint32_t>>,
+        Field<&Capabilities::node_id, BigEndian<std::uint64_t>>>;
+};
 
-        asio::error_code err;
-        asio::write(stream, packet_data, err);
-        if (err) {
-            throw ConnectionClosed();
-        }
+// Chunk of the connection's compressed stream, decompresses to one or more
+// complete frames
+struct Compressed {
+    static constexpr auto msg_type = MessageType::CompressedType;
+    std::vector<std::uint8_t> payload;
+
+    using schema = Schema<Field<&Compressed::payload, Blob<std::uint32_t>>>;
+
+    // Frame header preceding a payload of 'size' bytes
+    static constexpr std::size_t header_size =
+        sizeof(MessageType) + sizeof(std::uint32_t);
+    static void encode_header(std::size_t size, std::uint8_t* out) {
+        out = BigEndian<MessageType>::encode(msg_type, out);
+        BigEndian<std::uint32_t>::encode(std::uint32_t(size), out);
     }
 };
 
-using Ipv4Bytes = asio::ip::address_v4::bytes_type;
-using Ipv6Bytes = asio::ip::address_v6::bytes_type;
+// Heartbeat, answered with a Pong carrying the same value. The value only
+// means something to the sender (its send time).
+struct Ping {
+    static constexpr auto msg_type = MessageType::PingType;
+    std::uint64_t value = 0;
 
-struct PeerDiscovery {
+    using schema = Schema<Field<&Ping::value, BigEndian<std::uint64_t>>>;
+};
 
-    static constexpr auto msg_type = MessageType::PeerDiscoveryType;
-    std::vector<Ipv4Bytes> ipv4_addresses;
-    std::vector<Ipv6Bytes> ipv6_addresses;
+struct Pong {
+    static constexpr auto msg_type = MessageType::PongType;
+    std::uint64_t value = 0;
 
-    template<typename AsyncReadStream>
-    static asio::awaitable<PeerDiscovery> read(AsyncReadStream& stream) {
-        PeerDiscovery result;
+    using schema = Schema<Field<&Pong::value, BigEndian<std::uint64_t>>>;
+};
 
-        // 1. Read 'count_ipv4' from stream
-        std::uint8_t count_ipv4;
-        auto [err1, len1] = co_await asio::async_read(
-            stream,
-            asio::buffer(&count_ipv4, sizeof(std::uint8_t)),
-            use_nothrow_awaitable
-        );
-        if (err1) {
-            throw ConnectionClosed();
-        }
+// File transfer (see file_transfer.hpp): the sender offers a file, the
+// receiver accepts it from an offset (non zero when resuming), chunks flow
+// while the receiver acknowledges what it wrote.
+struct FileOffer {
+    static constexpr auto msg_type = MessageType::FileOfferType;
+    std::uint64_t transfer_id = 0;
+    std::uint64_t size = 0;
+    std::string name;
 
-        // 2. Read 'count_ipv6' from stream
-        std::uint8_t count_ipv6;
-        auto [err2, len2] = co_await asio::async_read(
-            stream,
-            asio::buffer(&count_ipv6, sizeof(std::uint8_t)),
-            use_nothrow_awaitable
-        );
-        if (err2) {
-            throw ConnectionClosed();
-        }
+    using schema = Schema<
+        Field<&FileOffer::transfer_id, BigEndian<std::uint64_t>>,
+        Field<&FileOffer::size, BigEndian<std::uint64_t>>,
+        Field<&FileOffer::name, String<std::uint16_t>>>;
+};
 
-        // 3. Read 'ipv4_addresses' from stream
-        result.ipv4_addresses.resize(count_ipv4);
-        auto [err3, len3] = co_await asio::async_read(
-            stream,
-            asio::buffer(
-                result.ipv4_addresses.data(), sizeof(Ipv4Bytes) * count_ipv4
-            ),
-            use_nothrow_awaitable
-        );
-        if (err3) {
-            throw ConnectionClosed();
-        }
-        // TODO: Figure out if I need to revert the bytes here
-
-        // 4. Read 'ipv6_addresses' from stream
-        result.ipv6_addresses.resize(count_ipv6);
-        auto [err4, len4] = co_await asio::async_read(
-            stream,
-            asio::buffer(
-                result.ipv6_addresses.data(), sizeof(Ipv6Bytes) * count_ipv6
-            ),
-            use_nothrow_awaitable
-        );
-        if (err4) {
-            throw ConnectionClosed();
-        }
-        // TODO: Figure out if I need to revert the bytes here
+struct FileAccept {
+    static constexpr auto msg_type = MessageType::FileAcceptType;
+    std::uint64_t transfer_id = 0;
+    std::uint64_t offset = 0;
+
+    using schema = Schema<
+        Field<&FileAccept::transfer_id, BigEndian<std::uint64_t>>,
+        Field<&FileAccept::offset, BigEndian<std::uint64_t>>>;
+};
+
+// The offer won't be accepted, the sender forgets it
+struct FileDecline {
+    static constexpr auto msg_type = MessageType::FileDeclineType;
+    std::uint64_t transfer_id = 0;
 
-        co_return result;
+    using schema =
+        Schema<Field<&FileDecline::transfer_id, BigEndian<std::uint64_t>>>;
+};
+
+// The data is a view over the receive buffer
+struct FileChunk {
+    static constexpr auto msg_type = MessageType::FileChunkType;
+    std::uint64_t transfer_id = 0;
+    std::uint64_t offset = 0;
+    std::span<const std::uint8_t> data;
+
+    using schema = Schema<
+        Field<&FileChunk::transfer_id, BigEndian<std::uint64_t>>,
+        Field<&FileChunk::offset, BigEndian<std::uint64_t>>,
+        Field<&FileChunk::data, BlobView<std::uint32_t>>>;
+
+    // Frame header preceding 'size' bytes of data, the sender writes the
+    // data straight from the file
+    static constexpr std::size_t header_size = sizeof(MessageType) +
+                                               2 * sizeof(std::uint64_t) +
+                                               sizeof(std::uint32_t);
+    static void encode_header(
+        std::uint64_t transfer_id,
+        std::uint64_t offset,
+        std::size_t size,
+        std::uint8_t* out
+    ) {
+        out = BigEndian<MessageType>::encode(msg_type, out);
+        out = BigEndian<std::uint64_t>::encode(transfer_id, out);
+        out = BigEndian<std::uint64_t>::encode(offset, out);
+        BigEndian<std::uint32_t>::encode(std::uint32_t(size), out);
     }
+};
 
-    template<typename SyncWriteStream>
-    void write(SyncWriteStream& stream) const {
-        fmt::print(stderr, "Write Ipv4's:\n");
-        for (const auto& address : ipv4_addresses) {
-            fmt::print(
-                stderr,
-                "{}.{}.{}.{}\n",
-                address[0],
-                address[1],
-                address[2],
-                address[3]
-            );
-        }
-        std::uint8_t count_ipv4 = ipv4_addresses.size();
-        std::uint8_t count_ipv6 = ipv6_addresses.size();
-        std::vector<asio::const_buffer> packet_data{
-            asio::buffer(&msg_type, sizeof(std::uint8_t)),
-            asio::buffer(&count_ipv4, sizeof(std::uint8_t)),
-            asio::buffer(&count_ipv6, sizeof(std::uint8_t)),
-            asio::buffer(
-                ipv4_addresses.data(), sizeof(Ipv4Bytes) * ipv4_addresses.size()
-            ),
-            asio::buffer(
-                ipv6_addresses.data(), sizeof(Ipv6Bytes) * ipv6_addresses.size()
-            )
-        };
+// Bytes written to disk so far, opens the sender's window
+struct FileAck {
+    static constexpr auto msg_type = MessageType::FileAckType;
+    std::uint64_t transfer_id = 0;
+    std::uint64_t offset = 0;
 
-        asio::error_code err;
-        asio::write(stream, packet_data, err);
-        if (err) {
-            throw ConnectionClosed();
-        }
+    using schema = Schema<
+        Field<&FileAck::transfer_id, BigEndian<std::uint64_t>>,
+        Field<&FileAck::offset, BigEndian<std::uint64_t>>>;
+};
+
+// Part of a frame too large to be sent at once, see OutboundQueue. The
+// fragments of a frame are sent in order on the stream of its priority
+// class, the receiver handles the frame once the last one arrived. The data
+// is a view over the receive buffer.
+struct Fragment {
+    static constexpr auto msg_type = MessageType::FragmentType;
+    std::uint8_t stream = 0;
+    std::uint8_t last = 0;
+    std::span<const std::uint8_t> data;
+
+    using schema = Schema<
+        Field<&Fragment::stream, BigEndian<std::uint8_t>>,
+        Field<&Fragment::last, BigEndian<std::uint8_t>>,
+        Field<&Fragment::data, BlobView<std::uint32_t>>>;
+
+    // Frame header preceding 'size' bytes of data, which are sent straight
+    // from the fragmented frame
+    static constexpr std::size_t header_size =
+        sizeof(MessageType) + 2 * sizeof(std::uint8_t) + sizeof(std::uint32_t);
+    static void encode_header(
+        std::uint8_t stream,
+        bool last,
+        std::size_t size,
+        std::uint8_t* out
+    ) {
+        out = BigEndian<MessageType>::encode(msg_type, out);
+        out = BigEndian<std::uint8_t>::encode(stream, out);
+        out = BigEndian<std::uint8_t>::encode(last ? 1 : 0, out);
+        BigEndian<std::uint32_t>::encode(std::uint32_t(size), out);
     }
 };
 
-struct Packet : public Variant<TextMessage, SetName, PeerDiscovery> {
-    using Variant<TextMessage, SetName, PeerDiscovery>::Variant;
+// Multicast datagram advertising a node on the LAN (see discovery.hpp),
+// never sent on a connection
+struct Announce {
+    static constexpr auto msg_type = MessageType::AnnounceType;
+    // Tells our datagrams apart from other traffic on the group
+    static constexpr std::uint32_t expected_magic = 0x50455050; // "PEPP"
+
+    std::uint32_t magic = expected_magic;
+    std::uint64_t node_id = 0;
+    // TCP port the node accepts peers on
+    std::uint16_t port = 0;
+    std::string name;
+
+    using schema = Schema<
+        Field<&Announce::magic, BigEndian<std::uint32_t>>,
+        Field<&Announce::node_id, BigEndian<std::uint64_t>>,
+        Field<&Announce::port, BigEndian<std::uint16_t>>,
+        Field<&Announce::name, String<std::uint8_t>>>;
+};
+
+using PacketMessages = MessageSet<
+    TextMessage,
+    SetName,
+    PeerDiscovery,
+    TextBatch,
+    Capabilities,
+    Compressed,
+    Ping,
+    Pong,
+    FileOffer,
+    FileAccept,
+    FileChunk,
+    FileAck,
+    Fragment,
+    FileDecline>;
+
+struct Packet
+    : public Variant<
+          TextMessage,
+          SetName,
+          PeerDiscovery,
+          TextBatch,
+          Capabilities,
+          Compressed,
+          Ping,
+          Pong,
+          FileOffer,
+          FileAccept,
+          FileChunk,
+          FileAck,
+          Fragment,
+          FileDecline> {
+    using Variant::Variant;
+
+    static Packet capabilities(std::uint32_t flags, std::uint64_t node_id) {
+        return { Capabilities{ .flags = flags, .node_id = node_id } };
+    }
+
+    static Packet ping(std::uint64_t value) {
+        return { Ping{ .value = value } };
+    }
+
+    static Packet pong(std::uint64_t value) {
+        return { Pong{ .value = value } };
+    }
+
+    static Packet file_offer(
+        std::uint64_t transfer_id,
+        std::uint64_t size,
+        std::string&& name
+    ) {
+        truncate(name, String<std::uint16_t>::max_size);
+        return { FileOffer{ .transfer_id = transfer_id,
+                            .size = size,
+                            .name = std::move(name) } };
+    }
+
+    static Packet file_accept(std::uint64_t transfer_id, std::uint64_t offset) {
+        return { FileAccept{ .transfer_id = transfer_id, .offset = offset } };
+    }
 
-    static constexpr Packet text_message(std::string&& msg) {
-        // TODO: name needs to have size < std::uint32_t::max()
-        return { TextMessage{ .size = std::uint32_t(msg.size()),
-                              .text = std::move(msg) } };
+    static Packet file_decline(std::uint64_t transfer_id) {
+        return { FileDecline{ .transfer_id = transfer_id } };
     }
 
-    static constexpr Packet set_name(std::string&& name) {
-        // TODO: name needs to have size < std::uint8_t::max() (implement
-        // security checks)
-        return { SetName{ .size = std::uint8_t(name.size()),
-                          .name = std::move(name) } };
+    static Packet file_ack(std::uint64_t transfer_id, std::uint64_t offset) {
+        return { FileAck{ .transfer_id = transfer_id, .offset = offset } };
     }
 
-    static constexpr Packet peer_discovery(
+    static Packet set_name(std::string&& name) {
+        truncate(name, String<std::uint8_t>::max_size);
+        return { SetName{ .name = std::move(name) } };
+    }
+
+    static Packet peer_discovery(
         std::ranges::input_range auto&& ipv4_addresses,
         std::ranges::input_range auto&& ipv6_addresses
     ) {
-        return { PeerDiscovery{
+        PeerDiscovery result{
             .ipv4_addresses =
                 std::vector(ipv4_addresses.begin(), ipv4_addresses.end()),
             .ipv6_addresses =
-                std::vector(ipv6_addresses.begin(), ipv6_addresses.end()) } };
+                std::vector(ipv6_addresses.begin(), ipv6_addresses.end())
+        };
+        truncate(result.ipv4_addresses, Ipv4List::max_size);
+        truncate(result.ipv6_addresses, Ipv6List::max_size);
+        return { std::move(result) };
     }
 
-    template<typename SyncWriteStream>
-    void write(SyncWriteStream& stream) const {
-        // Create concept to visit and ensure read and write
-        // member functions.
-        match([&stream](auto&& var) { var.write(stream); });
-        // text_message.write(stream);
+    // Exact size of the wire representation
+    [[nodiscard]] std::size_t encoded_size() const {
+        return std::visit(
+            [](const auto& msg) {
+                return Codec<std::decay_t<decltype(msg)>>::encoded_size(msg);
+            },
+            *this
+        );
     }
 
-    template<typename AsyncReadStream>
-    static asio::awaitable<Packet> read(AsyncReadStream& stream) {
-        [[clang::uninitialized]] MessageType message_type;
-        auto [err, len] = co_await asio::async_read(
-            stream,
-            asio::buffer(&message_type, sizeof(MessageType)),
-            use_nothrow_awaitable
+    // Serializes the packet into 'out', which must hold at least
+    // encoded_size() bytes. Returns the end of the written bytes.
+    std::uint8_t* encode(std::uint8_t* out) const {
+        return std::visit(
+            [out](const auto& msg) {
+                return Codec<std::decay_t<decltype(msg)>>::encode(msg, out);
+            },
+            *this
         );
+    }
 
-        if (err) {
-            throw ConnectionClosed();
-        }
+    [[nodiscard]] std::vector<std::uint8_t> encode() const {
+        std::vector<std::uint8_t> result(encoded_size());
+        encode(result.data());
+        return result;
+    }
+
+    // The frame's storage is recycled once every owner released it
+    [[nodiscard]] WireBuffer encode_shared() const {
+        return FramePool::global().make(encoded_size(), [this](auto* out) {
+            encode(out);
+        });
+    }
+
+    // Decodes the next frame in 'reader'. Returns std::nullopt when the frame
+    // is not complete yet, nothing is consumed in that case.
+    static std::optional<Packet> decode(ByteReader& reader) {
+        return PacketMessages::decode<Packet>(reader);
+    }
 
-        switch (message_type) {
-            case MessageType::TextMessageType: {
-                Packet result = co_await TextMessage::read(stream);
-                co_return result;
-                break;
-            }
-            case MessageType::SetNameType: {
-                Packet result = co_await SetName::read(stream);
-                co_return result;
-                break;
-            }
-            case MessageType::PeerDiscoveryType: {
-                Packet result = co_await PeerDiscovery::read(stream);
-                co_return result;
-                break;
-            }
-            default: {
-                throw ConnectionClosed();
-            }
+private:
+    static void truncate(auto& container, std::size_t max_size) {
+        if (container.size() > max_size) {
+            container.resize(max_size);
         }
     }
 };
 
-} // namespace peppe
\ No newline at end of file
+} // namespace peppe
@@ -0,0 +1,348 @@
+#include "message_log.hpp"
+#include "logger.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace peppe {
+
+namespace {
+
+std::filesystem::path segment_path(
+    const std::filesystem::path& directory,
+    std::size_t first_index,
+    std::string_view extension
+) {
+    return directory / fmt::format("{:020}.{}", first_index, extension);
+}
+
+template<typename T>
+T load(const std::uint8_t* data) {
+    T result;
+    std::memcpy(&result, data, sizeof(T));
+    return result;
+}
+
+template<typename T>
+std::uint8_t* store(std::uint8_t* out, T value) {
+    std::memcpy(out, &value, sizeof(T));
+    return out + sizeof(T);
+}
+
+} // namespace
+
+MessageLog::MessageLog(const HistoryConfig& config)
+    : m_config(config) {
+    if (!m_config.directory.empty()) {
+        std::error_code err;
+        std::filesystem::create_directories(m_config.directory, err);
+        if (err) {
+            log_error(
+                "Failed creating log directory '{}': {}",
+                m_config.directory,
+                err.message()
+            );
+        }
+        else {
+            m_persistent = lock_directory();
+        }
+    }
+
+    if (m_persistent) {
+        try {
+            open_segments();
+        }
+        catch (const std::system_error& err) {
+            log_error(
+                "Failed opening log directory '{}', the history is kept in "
+                "memory: {}",
+                m_config.directory,
+                err.what()
+            );
+            close();
+        }
+    }
+}
+
+MessageLog::~MessageLog() {
+    close();
+}
+
+void MessageLog::close() {
+    for (auto& segment : m_segments) {
+        ::munmap(segment.data.data, segment.data.size);
+        ::munmap(segment.index.data, segment.index.size);
+    }
+    m_segments.clear();
+    m_size = 0;
+    m_persistent = false;
+    if (m_lock_fd >= 0) {
+        ::close(m_lock_fd);
+        m_lock_fd = -1;
+    }
+}
+
+bool MessageLog::lock_directory() {
+    const auto path = std::filesystem::path(m_config.directory) / "lock";
+    m_lock_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_lock_fd >= 0 && ::flock(m_lock_fd, LOCK_EX | LOCK_NB) == 0) {
+        return true;
+    }
+    log_warn(
+        "Failed locking log directory '{}', the history is kept in memory: {}",
+        m_config.directory,
+        std::strerror(errno)
+    );
+    if (m_lock_fd >= 0) {
+        ::close(m_lock_fd);
+        m_lock_fd = -1;
+    }
+    return false;
+}
+
+void MessageLog::open_segments() {
+    std::vector<std::size_t> first_indices;
+    for (const auto& entry :
+         std::filesystem::directory_iterator(m_config.directory)) {
+        const auto& path = entry.path();
+        if (path.extension() != ".log") {
+            continue;
+        }
+        const auto stem = path.stem().string();
+        std::size_t first_index = 0;
+        const auto res = std::from_chars(
+            stem.data(), stem.data() + stem.size(), first_index
+        );
+        if (res.ec == std::errc{}) {
+            first_indices.push_back(first_index);
+        }
+    }
+    std::ranges::sort(first_indices);
+
+    for (const auto first_index : first_indices) {
+        const auto data_path =
+            segment_path(m_config.directory, first_index, "log");
+        const auto index_path =
+            segment_path(m_config.directory, first_index, "idx");
+
+        std::error_code err;
+        const auto data_size = std::filesystem::file_size(data_path, err);
+        const auto index_size = std::filesystem::file_size(index_path, err);
+        // An empty file can't be mapped, the segment was never written to
+        if (err || first_index != m_size || data_size == 0 ||
+            index_size < sizeof(std::uint64_t)) {
+            log_warn("Ignoring log segments from '{}'", data_path.string());
+            break;
+        }
+
+        Segment segment{
+            .first_index = first_index,
+            .count = 0,
+            .data = map(data_path, data_size),
+            .index = {},
+        };
+        try {
+            segment.index = map(index_path, index_size);
+        }
+        catch (const std::system_error&) {
+            ::munmap(segment.data.data, segment.data.size);
+            throw;
+        }
+        segment.count = valid_count(segment);
+        m_size += segment.count;
+        m_segments.push_back(segment);
+        if (segment.count < segment.capacity() &&
+            segment.offsets()[segment.count] != 0) {
+            log_warn(
+                "Log segment '{}' is truncated after {} records",
+                data_path.string(),
+                segment.count
+            );
+            // Appends restart after the last valid record, entries left
+            // after it would be taken for records when reopened
+            for (auto i = segment.count;
+                 i < segment.capacity() && segment.offsets()[i] != 0;
+                 ++i) {
+                segment.offsets()[i] = 0;
+            }
+            // Following segments would leave a gap in the indices
+            break;
+        }
+    }
+}
+
+std::size_t MessageLog::valid_count(const Segment& segment) {
+    // Records the index points to are checked before they are trusted: a
+    // crash or a damaged file must not make a read leave the mapping
+    const auto* offsets = segment.offsets();
+    std::uint64_t begin = 0;
+    for (std::size_t i = 0; i < segment.capacity(); ++i) {
+        const auto end = offsets[i];
+        if (end <= begin || end > segment.data.size ||
+            end - begin < record_header_size) {
+            return i;
+        }
+        const auto* record = segment.data.data + begin;
+        const auto username_len = load<std::uint8_t>(record + 9);
+        const auto content_len = load<std::uint32_t>(record + 10);
+        if (record_header_size + username_len + content_len != end - begin) {
+            return i;
+        }
+        begin = end;
+    }
+    return segment.capacity();
+}
+
+MessageLog::Segment&
+MessageLog::create_segment(std::size_t first_index, std::size_t min_size) {
+    const std::size_t data_size = std::max(m_config.segment_size, min_size);
+    // Enough entries for a segment full of empty records
+    const std::size_t index_size =
+        (data_size / record_header_size + 1) * sizeof(std::uint64_t);
+
+    // Anonymous memory when the paths are empty
+    std::filesystem::path data_path;
+    std::filesystem::path index_path;
+    if (m_persistent) {
+        data_path = segment_path(m_config.directory, first_index, "log");
+        index_path = segment_path(m_config.directory, first_index, "idx");
+        // Left over by a segment ignored when opening the log
+        std::error_code ignored;
+        std::filesystem::remove(data_path, ignored);
+        std::filesystem::remove(index_path, ignored);
+    }
+
+    Segment segment{
+        .first_index = first_index,
+        .data = map(data_path, data_size),
+        .index = {},
+    };
+    try {
+        segment.index = map(index_path, index_size);
+    }
+    catch (const std::system_error&) {
+        ::munmap(segment.data.data, segment.data.size);
+        throw;
+    }
+    return m_segments.emplace_back(segment);
+}
+
+MessageLog::Mapping MessageLog::map(
+    const std::filesystem::path& path,
+    std::size_t size
+) const {
+    void* data = MAP_FAILED;
+    if (path.empty()) {
+        data = ::mmap(
+            nullptr,
+            size,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+            -1,
+            0
+        );
+    }
+    else {
+        const int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+        // Sparse file, untouched pages don't use any disk space
+        struct stat st {};
+        if (::fstat(fd, &st) == 0 && std::size_t(st.st_size) < size) {
+            if (::ftruncate(fd, off_t(size)) != 0) {
+                ::close(fd);
+                throw std::system_error(errno, std::generic_category(), path);
+            }
+        }
+        data = ::mmap(
+            nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0
+        );
+        ::close(fd);
+    }
+
+    if (data == MAP_FAILED) {
+        throw std::system_error(errno, std::generic_category(), "mmap");
+    }
+    return { static_cast<std::uint8_t*>(data), size };
+}
+
+void MessageLog::append(
+    std::int64_t timestamp,
+    bool is_me,
+    std::string_view username,
+    std::string_view content
+) {
+    username = username.substr(0, UINT8_MAX);
+    content = content.substr(0, UINT32_MAX);
+    const std::size_t record_size =
+        record_header_size + username.size() + content.size();
+
+    std::lock_guard lock(m_mutex);
+    // Start a new segment when the record doesn't fit
+    if (m_segments.empty() ||
+        m_segments.back().end_offset() + record_size >
+            m_segments.back().data.size ||
+        m_segments.back().count == m_segments.back().capacity()) {
+        try {
+            create_segment(m_size, record_size);
+        }
+        catch (const std::system_error& err) {
+            log_error("Failed storing a message: {}", err.what());
+            return;
+        }
+    }
+
+    Segment& segment = m_segments.back();
+    const auto offset = segment.end_offset();
+    std::uint8_t* out = segment.data.data + offset;
+    out = store(out, timestamp);
+    out = store(out, std::uint8_t(is_me));
+    out = store(out, std::uint8_t(username.size()));
+    out = store(out, std::uint32_t(content.size()));
+    out = std::ranges::copy(username, out).out;
+    std::ranges::copy(content, out);
+
+    // The index entry is written last, a record is only visible once it is
+    // complete
+    segment.offsets()[segment.count] = offset + record_size;
+    ++segment.count;
+    ++m_size;
+}
+
+HistoryRecord MessageLog::operator[](std::size_t index) const {
+    std::lock_guard lock(m_mutex);
+    // Last segment whose first index is <= index
+    const auto it = std::ranges::upper_bound(
+        m_segments, index, {}, &Segment::first_index
+    );
+    const Segment& segment = *std::prev(it);
+    const std::size_t local = index - segment.first_index;
+    const std::uint64_t begin =
+        (local == 0) ? 0 : segment.offsets()[local - 1];
+
+    const std::uint8_t* data = segment.data.data + begin;
+    HistoryRecord result;
+    result.timestamp = load<std::int64_t>(data);
+    result.is_me = load<std::uint8_t>(data + 8) != 0;
+    const auto username_len = load<std::uint8_t>(data + 9);
+    const auto content_len = load<std::uint32_t>(data + 10);
+    const auto* username = reinterpret_cast<const char*>(data + 14);
+    result.username = std::string_view(username, username_len);
+    result.content =
+        std::string_view(username + username_len, content_len);
+    return result;
+}
+
+} // namespace peppe
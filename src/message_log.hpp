@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace peppe {
+
+struct HistoryConfig {
+    // Empty to keep the history in memory only
+    std::string directory = "history";
+    std::size_t segment_size = 64 * 1024 * 1024;
+};
+
+// Stored message. The views point into the mapped segment and stay valid for
+// the lifetime of the log, whatever is appended meanwhile.
+struct HistoryRecord {
+    std::int64_t timestamp = 0;
+    bool is_me = false;
+    std::string_view username;
+    std::string_view content;
+};
+
+// Append-only message history split in fixed-size segments.
+//
+// Each segment is a pair of memory-mapped files:
+// - 'NNN.log' holds the records back to back:
+//   [timestamp: i64][is_me: u8][username_len: u8][content_len: u32]
+//   [username][content]
+// - 'NNN.idx' holds the end offset of every record in 'NNN.log', so a record
+//   is found without scanning the segment. Unused entries are zero.
+// where NNN is the index of the first record of the segment.
+//
+// Received messages are appended from the network threads while the UI
+// thread reads the history, every access is synchronized.
+//
+// The directory is locked for the lifetime of the log: another process
+// sharing it would corrupt the mapped segments, and keeps its history in
+// memory instead.
+//
+// Opening the log maps the segments and checks the record boundaries, a
+// segment is cut at its first damaged record (a crash in the middle of an
+// append). The records are never copied: the kernel pages them in when read
+// and can drop them again, only the pages being displayed stay resident.
+class MessageLog {
+public:
+    // Ctor
+    explicit MessageLog(const HistoryConfig& config);
+    // Copy
+    MessageLog(MessageLog const&) = delete;
+    MessageLog& operator=(MessageLog const&) = delete;
+    // Move
+    MessageLog(MessageLog&&) = delete;
+    MessageLog& operator=(MessageLog&&) = delete;
+    // Dtor
+    ~MessageLog();
+
+    [[nodiscard]] std::size_t size() const {
+        std::lock_guard lock(m_mutex);
+        return m_size;
+    }
+
+    // A record that can't be stored is dropped, the error is logged
+    void append(
+        std::int64_t timestamp,
+        bool is_me,
+        std::string_view username,
+        std::string_view content
+    );
+
+    [[nodiscard]] HistoryRecord operator[](std::size_t index) const;
+
+private:
+    struct Mapping {
+        std::uint8_t* data = nullptr;
+        std::size_t size = 0;
+    };
+
+    struct Segment {
+        std::size_t first_index = 0;
+        std::size_t count = 0;
+        Mapping data;
+        Mapping index;
+
+        [[nodiscard]] std::uint64_t* offsets() const {
+            return reinterpret_cast<std::uint64_t*>(index.data);
+        }
+        [[nodiscard]] std::size_t capacity() const {
+            return index.size / sizeof(std::uint64_t);
+        }
+        [[nodiscard]] std::uint64_t end_offset() const {
+            return (count == 0) ? 0 : offsets()[count - 1];
+        }
+    };
+
+    static constexpr std::size_t record_header_size =
+        sizeof(std::int64_t) + 2 * sizeof(std::uint8_t) + sizeof(std::uint32_t);
+
+    // Exclusive lock on 'lock' in the directory, false if it's taken
+    [[nodiscard]] bool lock_directory();
+    // Unmaps the segments and releases the directory
+    void close();
+    void open_segments();
+    // Number of leading records of the segment whose bounds are consistent
+    [[nodiscard]] static std::size_t valid_count(const Segment& segment);
+    Segment& create_segment(std::size_t first_index, std::size_t min_size);
+    [[nodiscard]] Mapping map(
+        const std::filesystem::path& path,
+        std::size_t size
+    ) const;
+
+    HistoryConfig m_config;
+    mutable std::mutex m_mutex;
+    bool m_persistent = false;
+    int m_lock_fd = -1;
+    std::vector<Segment> m_segments;
+    std::size_t m_size = 0;
+};
+
+} // namespace peppe
@@ -0,0 +1,276 @@
+#include "metrics.hpp"
+
+#include "gossip.hpp"
+
+#include <fmt/core.h>
+#include <iterator>
+
+namespace peppe {
+
+namespace {
+
+// Histogram buckets exported, from 1us to ~17s
+constexpr unsigned first_exported_exponent = 10;
+constexpr unsigned last_exported_exponent = 34;
+
+std::string escape_label(std::string_view value) {
+    std::string result;
+    result.reserve(value.size());
+    for (const char c : value) {
+        switch (c) {
+        case '\\':
+            result += "\\\\";
+            break;
+        case '"':
+            result += "\\\"";
+            break;
+        case '\n':
+            result += "\\n";
+            break;
+        default:
+            result += c;
+        }
+    }
+    return result;
+}
+
+void write_header(
+    std::string& out,
+    std::string_view name,
+    std::string_view type,
+    std::string_view help
+) {
+    fmt::format_to(
+        std::back_inserter(out),
+        "# HELP {} {}\n# TYPE {} {}\n",
+        name,
+        help,
+        name,
+        type
+    );
+}
+
+void write_counter(
+    std::string& out,
+    std::string_view name,
+    std::string_view help,
+    std::uint64_t value
+) {
+    write_header(out, name, "counter", help);
+    fmt::format_to(std::back_inserter(out), "{} {}\n", name, value);
+}
+
+// Durations are exported in seconds, as Prometheus expects
+void write_histogram(
+    std::string& out,
+    std::string_view name,
+    std::string_view help,
+    const Histogram& histogram
+) {
+    write_header(out, name, "histogram", help);
+    for (unsigned exponent = first_exported_exponent;
+         exponent <= last_exported_exponent;
+         ++exponent) {
+        fmt::format_to(
+            std::back_inserter(out),
+            "{}_bucket{{le=\"{:g}\"}} {}\n",
+            name,
+            double(std::uint64_t(1) << exponent) / 1e9,
+            histogram.count_below_pow2(exponent)
+        );
+    }
+    const auto count = histogram.count();
+    fmt::format_to(
+        std::back_inserter(out),
+        "{0}_bucket{{le=\"+Inf\"}} {1}\n{0}_sum {2:g}\n{0}_count {1}\n",
+        name,
+        count,
+        double(histogram.sum()) / 1e9
+    );
+}
+
+// One sample per peer
+template<typename Getter>
+void write_peer_metric(
+    std::string& out,
+    const std::vector<PeerMetrics>& peers,
+    std::string_view name,
+    std::string_view type,
+    std::string_view help,
+    Getter getter
+) {
+    write_header(out, name, type, help);
+    for (const auto& peer : peers) {
+        fmt::format_to(
+            std::back_inserter(out),
+            "{}{{peer=\"{}\",name=\"{}\"}} {}\n",
+            name,
+            escape_label(peer.peer),
+            escape_label(peer.name.value_or("")),
+            getter(peer)
+        );
+    }
+}
+
+} // namespace
+
+std::string render_metrics(
+    const std::vector<PeerMetrics>& peers,
+    const GossipStats& gossip
+) {
+    const auto& metrics = Metrics::global();
+    std::string out;
+
+    // Connections
+    write_header(out, "peppe_peers", "gauge", "Connected peers");
+    fmt::format_to(std::back_inserter(out), "peppe_peers {}\n", peers.size());
+    write_counter(
+        out,
+        "peppe_connections_opened_total",
+        "Sessions started",
+        metrics.connections_opened.value()
+    );
+    write_counter(
+        out,
+        "peppe_connections_closed_total",
+        "Sessions ended",
+        metrics.connections_closed.value()
+    );
+    write_counter(
+        out,
+        "peppe_reconnects_total",
+        "Peers connecting again with a node id already seen",
+        metrics.reconnects.value()
+    );
+    write_counter(
+        out,
+        "peppe_protocol_errors_total",
+        "Sessions closed because of an invalid frame",
+        metrics.protocol_errors.value()
+    );
+
+    // Per peer
+    write_peer_metric(
+        out,
+        peers,
+        "peppe_peer_reads_total",
+        "counter",
+        "Read operations issued on the socket",
+        [](const PeerMetrics& p) { return p.reads; }
+    );
+    write_peer_metric(
+        out,
+        peers,
+        "peppe_peer_frames_received_total",
+        "counter",
+        "Frames received",
+        [](const PeerMetrics& p) { return p.frames_received; }
+    );
+    write_peer_metric(
+        out,
+        peers,
+        "peppe_peer_bytes_received_total",
+        "counter",
+        "Bytes received",
+        [](const PeerMetrics& p) { return p.bytes_received; }
+    );
+    write_peer_metric(
+        out,
+        peers,
+        "peppe_peer_frames_sent_total",
+        "counter",
+        "Frames written",
+        [](const PeerMetrics& p) { return p.frames_sent; }
+    );
+    write_peer_metric(
+        out,
+        peers,
+        "peppe_peer_bytes_sent_total",
+        "counter",
+        "Frame bytes written, before compression",
+        [](const PeerMetrics& p) { return p.bytes_sent; }
+    );
+    write_peer_metric(
+        out,
+        peers,
+        "peppe_peer_frames_dropped_total",
+        "counter",
+        "Frames dropped by the outbound queue",
+        [](const PeerMetrics& p) { return p.frames_dropped; }
+    );
+    write_peer_metric(
+        out,
+        peers,
+        "peppe_peer_queue_frames",
+        "gauge",
+        "Frames waiting in the outbound queue",
+        [](const PeerMetrics& p) { return p.queue_frames; }
+    );
+    write_peer_metric(
+        out,
+        peers,
+        "peppe_peer_queue_bytes",
+        "gauge",
+        "Bytes waiting in the outbound queue",
+        [](const PeerMetrics& p) { return p.queue_bytes; }
+    );
+
+    write_header(
+        out, "peppe_peer_rtt_seconds", "gauge", "Smoothed round trip time"
+    );
+    for (const auto& peer : peers) {
+        if (!peer.rtt.has_value()) {
+            continue;
+        }
+        fmt::format_to(
+            std::back_inserter(out),
+            "peppe_peer_rtt_seconds{{peer=\"{}\",name=\"{}\"}} {:g}\n",
+            escape_label(peer.peer),
+            escape_label(peer.name.value_or("")),
+            double(peer.rtt->count()) / 1e6
+        );
+    }
+
+    // Gossip
+    write_counter(
+        out,
+        "peppe_gossip_originated_total",
+        "Messages written locally",
+        gossip.originated.load(std::memory_order_relaxed)
+    );
+    write_counter(
+        out,
+        "peppe_gossip_received_total",
+        "Relayed messages received, duplicates included",
+        gossip.received.load(std::memory_order_relaxed)
+    );
+    write_counter(
+        out,
+        "peppe_gossip_duplicates_total",
+        "Relayed messages dropped as duplicates",
+        gossip.duplicates.load(std::memory_order_relaxed)
+    );
+    write_counter(
+        out,
+        "peppe_gossip_forwarded_total",
+        "Frames queued when relaying",
+        gossip.forwarded.load(std::memory_order_relaxed)
+    );
+
+    // Latencies
+    write_histogram(
+        out,
+        "peppe_decode_seconds",
+        "Time to decode the frames of a read",
+        metrics.decode_ns
+    );
+    write_histogram(
+        out,
+        "peppe_event_dispatch_seconds",
+        "Time between a backend event and its handling by the frontend",
+        metrics.dispatch_ns
+    );
+    return out;
+}
+
+} // namespace peppe
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace peppe {
+
+struct GossipStats;
+
+///////////////////////////////
+// Instruments               //
+///////////////////////////////
+
+// Monotonic counter, only ever incremented with relaxed atomics
+class Counter {
+public:
+    void add(std::uint64_t value = 1) {
+        m_value.fetch_add(value, std::memory_order_relaxed);
+    }
+    [[nodiscard]] std::uint64_t value() const {
+        return m_value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::uint64_t> m_value = 0;
+};
+
+// Log-linear histogram of durations in nanoseconds (HDR style): every
+// power of two is split in 'sub_buckets' linear buckets, so any value is
+// recorded with a relative error under 1 / sub_buckets. Recording is a
+// couple of bit operations and relaxed increments, no lock.
+class Histogram {
+public:
+    static constexpr unsigned sub_bucket_bits = 3;
+    static constexpr std::size_t sub_buckets = 1U << sub_bucket_bits;
+    static constexpr std::size_t bucket_count =
+        (64 - sub_bucket_bits + 1) * sub_buckets;
+
+    void record(std::uint64_t value) {
+        m_buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void record(std::chrono::nanoseconds duration) {
+        record(std::uint64_t(std::max<std::int64_t>(duration.count(), 0)));
+    }
+
+    [[nodiscard]] std::uint64_t count() const {
+        return m_count.load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] std::uint64_t sum() const {
+        return m_sum.load(std::memory_order_relaxed);
+    }
+
+    // Number of recorded values below 2^exponent
+    [[nodiscard]] std::uint64_t count_below_pow2(unsigned exponent) const {
+        const auto end =
+            std::min(bucket_of(std::uint64_t(1) << exponent), bucket_count);
+        std::uint64_t result = 0;
+        for (std::size_t i = 0; i < end; ++i) {
+            result += m_buckets[i].load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    [[nodiscard]] static constexpr std::size_t bucket_of(std::uint64_t value) {
+        if (value < sub_buckets) {
+            return std::size_t(value);
+        }
+        const unsigned exponent = unsigned(std::bit_width(value)) - 1;
+        const auto sub = (value >> (exponent - sub_bucket_bits)) &
+                         (sub_buckets - 1);
+        return std::size_t(exponent - sub_bucket_bits + 1) * sub_buckets +
+               std::size_t(sub);
+    }
+
+private:
+    std::array<std::atomic<std::uint64_t>, bucket_count> m_buckets{};
+    std::atomic<std::uint64_t> m_count = 0;
+    std::atomic<std::uint64_t> m_sum = 0;
+};
+
+///////////////////////////////
+// Metrics                   //
+///////////////////////////////
+
+// Process wide instruments. Per-peer values live in each connection and
+// are collected when the metrics are rendered, see PeerMetrics.
+struct Metrics {
+    Counter connections_opened;
+    Counter connections_closed;
+    // Peers connecting again with a node id already seen
+    Counter reconnects;
+    Counter protocol_errors;
+    // Time to decode the frames of a single read
+    Histogram decode_ns;
+    // Time between a backend event being queued and the frontend handling it
+    Histogram dispatch_ns;
+
+    [[nodiscard]] static Metrics& global() {
+        static Metrics instance;
+        return instance;
+    }
+};
+
+// Snapshot of a connection's counters
+struct PeerMetrics {
+    // "address:port" or "unix:path"
+    std::string peer;
+    std::optional<std::string> name;
+    std::uint64_t reads = 0;
+    std::uint64_t frames_received = 0;
+    std::uint64_t bytes_received = 0;
+    std::uint64_t frames_sent = 0;
+    std::uint64_t bytes_sent = 0;
+    std::uint64_t frames_dropped = 0;
+    std::size_t queue_frames = 0;
+    std::size_t queue_bytes = 0;
+    std::optional<std::chrono::microseconds> rtt;
+};
+
+// Prometheus text exposition format (version 0.0.4)
+[[nodiscard]] std::string render_metrics(
+    const std::vector<PeerMetrics>& peers,
+    const GossipStats& gossip
+);
+
+} // namespace peppe
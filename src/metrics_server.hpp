@@ -0,0 +1,102 @@
+#pragma once
+
+#include "connection_table.hpp"
+#include "gossip.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+
+#include <asio/experimental/awaitable_operators.hpp>
+#include <asio/read_until.hpp>
+#include <asio/write.hpp>
+
+#include <array>
+#include <memory>
+#include <string>
+
+namespace peppe {
+
+// Minimal HTTP endpoint serving the metrics in the Prometheus text format
+// on 'GET /metrics'. Only listens on loopback.
+class MetricsServer {
+public:
+    // Ctor
+    MetricsServer(const ConnectionTable& table, const Gossip& gossip)
+        : m_connection_table_ref(table)
+        , m_gossip_ref(gossip) {}
+
+    awaitable<void> listen(asio::ip::port_type port) {
+        const auto executor = co_await this_coro::executor;
+        tcp::acceptor acceptor(
+            executor, { asio::ip::address_v4::loopback(), port }
+        );
+        log_info("Serving metrics on port '{}'", port);
+
+        while (true) {
+            auto [err, socket] =
+                co_await acceptor.async_accept(use_nothrow_awaitable);
+            if (err) {
+                continue;
+            }
+            auto client = std::make_shared<tcp::socket>(std::move(socket));
+            co_spawn(
+                executor,
+                [this, client] { return serve(client); },
+                detached
+            );
+        }
+    }
+
+private:
+    // Slow or idle scrapers are dropped
+    static constexpr auto request_timeout = std::chrono::seconds(5);
+    static constexpr std::size_t max_request_size = 8 * 1024;
+
+    awaitable<void> serve(std::shared_ptr<tcp::socket> socket) {
+        using namespace asio::experimental::awaitable_operators;
+
+        std::string request;
+        auto result = co_await (
+            asio::async_read_until(
+                *socket,
+                asio::dynamic_buffer(request, max_request_size),
+                "\r\n\r\n",
+                use_nothrow_awaitable
+            ) ||
+            timeout(request_timeout)
+        );
+        if (result.index() != 0 || std::get<0>(std::get<0>(result))) {
+            co_return;
+        }
+
+        std::string body;
+        std::string_view status = "200 OK";
+        if (request.starts_with("GET /metrics ")) {
+            body = render_metrics(
+                m_connection_table_ref.peer_metrics(), m_gossip_ref.stats()
+            );
+        }
+        else {
+            status = "404 Not Found";
+        }
+
+        const auto header = fmt::format(
+            "HTTP/1.1 {}\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: {}\r\n"
+            "Connection: close\r\n\r\n",
+            status,
+            body.size()
+        );
+        const std::array<asio::const_buffer, 2> buffers{
+            asio::buffer(header), asio::buffer(body)
+        };
+        co_await asio::async_write(*socket, buffers, use_nothrow_awaitable);
+        asio::error_code ignored;
+        socket->shutdown(tcp::socket::shutdown_both, ignored);
+    }
+
+    const ConnectionTable& m_connection_table_ref;
+    const Gossip& m_gossip_ref;
+};
+
+} // namespace peppe
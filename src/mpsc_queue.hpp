@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace peppe {
+
+// Bounded lock-free multi-producer/single-consumer queue (Vyukov's bounded
+// queue restricted to a single consumer). Producers never block: when the
+// queue is full the element is dropped and accounted for in dropped().
+template<typename T>
+class MpscQueue {
+public:
+    // Ctor (the capacity is rounded up to a power of two)
+    explicit MpscQueue(std::size_t capacity)
+        : m_mask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1)
+        , m_slots(std::make_unique<Slot[]>(m_mask + 1)) {
+        for (std::size_t i = 0; i <= m_mask; ++i) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    // Copy
+    MpscQueue(MpscQueue const&) = delete;
+    MpscQueue& operator=(MpscQueue const&) = delete;
+    // Move
+    MpscQueue(MpscQueue&&) = delete;
+    MpscQueue& operator=(MpscQueue&&) = delete;
+    // Dtor
+    ~MpscQueue() {
+        drain([](T&&) {});
+    }
+
+    // Can be called from any thread
+    template<typename U>
+    bool try_push(U&& value) {
+        std::size_t pos = m_tail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = m_slots[pos & m_mask];
+            const std::size_t seq =
+                slot.sequence.load(std::memory_order_acquire);
+            const auto diff = std::intptr_t(seq) - std::intptr_t(pos);
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed
+                    )) {
+                    std::construct_at(slot.ptr(), std::forward<U>(value));
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                // Full
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer only. Pops up to 'max_count' elements in FIFO order and
+    // returns how many were handed to 'func'.
+    template<typename F>
+    std::size_t drain(F&& func, std::size_t max_count = SIZE_MAX) {
+        std::size_t count = 0;
+        while (count < max_count) {
+            Slot& slot = m_slots[m_head & m_mask];
+            const std::size_t seq =
+                slot.sequence.load(std::memory_order_acquire);
+            if (seq != m_head + 1) {
+                // Empty (or the producer hasn't finished writing yet)
+                break;
+            }
+            func(std::move(*slot.ptr()));
+            std::destroy_at(slot.ptr());
+            slot.sequence.store(m_head + m_mask + 1, std::memory_order_release);
+            ++m_head;
+            ++count;
+        }
+        return count;
+    }
+
+    [[nodiscard]] std::size_t capacity() const { return m_mask + 1; }
+
+    [[nodiscard]] std::uint64_t dropped() const {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> sequence;
+        alignas(T) std::byte storage[sizeof(T)];
+
+        T* ptr() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    const std::size_t m_mask;
+    std::unique_ptr<Slot[]> m_slots;
+    // Producers and the consumer live on different cache lines
+    alignas(64) std::atomic<std::size_t> m_tail = 0;
+    alignas(64) std::size_t m_head = 0;
+    std::atomic<std::uint64_t> m_dropped = 0;
+};
+
+} // namespace peppe
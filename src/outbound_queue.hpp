@@ -0,0 +1,457 @@
+#pragma once
+
+#include <asio/io_context.hpp>
+#include <asio/post.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/strand.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "memory.hpp"
+#include "message.hpp"
+#include "ring_queue.hpp"
+
+namespace peppe {
+
+// Executor a session runs on. Sockets and timers name it rather than
+// asio::any_io_executor: a completion goes through the strand without
+// copying a type erased executor.
+using Strand = asio::strand<asio::io_context::executor_type>;
+using StrandTimer = asio::steady_timer::rebind_executor<Strand>::other;
+template<typename Protocol>
+using StrandSocket =
+    typename Protocol::socket::template rebind_executor<Strand>::other;
+
+// What to do with a peer whose outbound queue grew past the high watermark
+enum class OverflowPolicy : std::uint8_t {
+    // Reject new frames until the queue drains below the low watermark
+    DropNewest,
+    // Evict the oldest queued frames until the queue is below the low
+    // watermark
+    DropOldest,
+    // Close the connection
+    Disconnect,
+};
+
+[[nodiscard]] constexpr std::optional<OverflowPolicy>
+overflow_policy_from_string(std::string_view str) {
+    if (str == "drop_newest") {
+        return OverflowPolicy::DropNewest;
+    }
+    if (str == "drop_oldest") {
+        return OverflowPolicy::DropOldest;
+    }
+    if (str == "disconnect") {
+        return OverflowPolicy::Disconnect;
+    }
+    return std::nullopt;
+}
+
+// Classes frames are scheduled by, from the most to the least urgent
+enum class FramePriority : std::uint8_t {
+    // Handshake, heartbeats and file transfer signaling
+    Control,
+    // Chat messages
+    Interactive,
+    // Everything else: peer lists...
+    Bulk,
+};
+
+inline constexpr std::size_t frame_priority_count = 3;
+
+[[nodiscard]] constexpr FramePriority priority_of(MessageType type) {
+    switch (type) {
+        case MessageType::CapabilitiesType:
+        case MessageType::SetNameType:
+        case MessageType::PingType:
+        case MessageType::PongType:
+        case MessageType::FileOfferType:
+        case MessageType::FileAcceptType:
+        case MessageType::FileDeclineType:
+        case MessageType::FileAckType: {
+            return FramePriority::Control;
+        }
+        case MessageType::TextMessageType:
+        case MessageType::TextBatchType: {
+            return FramePriority::Interactive;
+        }
+        default: {
+            return FramePriority::Bulk;
+        }
+    }
+}
+
+struct OutboundConfig {
+    // Watermarks are expressed in queued bytes
+    std::size_t high_watermark = 4 * 1024 * 1024;
+    std::size_t low_watermark = 1 * 1024 * 1024;
+    OverflowPolicy policy = OverflowPolicy::DropOldest;
+    // Larger frames are sent as fragments once the peer can reassemble them
+    std::size_t fragment_size = 16 * 1024;
+};
+
+struct OutboundStats {
+    std::size_t depth_frames = 0;
+    std::size_t depth_bytes = 0;
+    std::uint64_t frames_sent = 0;
+    std::uint64_t bytes_sent = 0;
+    std::uint64_t frames_dropped = 0;
+    std::uint64_t high_watermark_hits = 0;
+};
+
+// Per-peer queue of encoded frames. Producers never block: a push only
+// appends to the queue and wakes the writer that drains it.
+// push() and close() may be called from any thread, pop_batch() and
+// async_wait() must run on the strand the queue was created with.
+//
+// Every priority class has its own FIFO. Batches are scheduled by deficit
+// round robin: each round, a class may send up to its weight times
+// 'quantum' bytes, control frames first. Frames larger than the fragment
+// size are split, so a peer list or a long text never holds the socket for
+// more than a fragment. A control frame waits for the batch being written
+// at most, about 'max_batch_size' bytes whatever the bulk backlog.
+class OutboundQueue {
+public:
+    using Frame = WireBuffer;
+
+    static constexpr std::size_t quantum = 16 * 1024;
+    static constexpr std::array<std::size_t, frame_priority_count> weights{
+        8, 4, 1
+    };
+    // Rounds are added to a batch until it reaches this size
+    static constexpr std::size_t max_batch_size = 256 * 1024;
+
+    // What the writer sends for a scheduled frame: the whole frame, or its
+    // next fragment preceded by a Fragment header
+    struct Slice {
+        Frame frame;
+        std::size_t offset = 0;
+        std::size_t size = 0;
+        bool fragment = false;
+        std::array<std::uint8_t, Fragment::header_size> header{};
+
+        [[nodiscard]] std::span<const std::uint8_t> header_bytes() const {
+            if (!fragment) {
+                return {};
+            }
+            return header;
+        }
+        [[nodiscard]] std::span<const std::uint8_t> bytes() const {
+            return std::span(*frame).subspan(offset, size);
+        }
+        [[nodiscard]] std::size_t wire_size() const {
+            return header_bytes().size() + size;
+        }
+    };
+
+    enum class PushResult : std::uint8_t {
+        Queued,
+        Dropped,
+        Disconnect,
+    };
+
+    enum class PopResult : std::uint8_t {
+        Batch,
+        // Nothing to send, wait with async_wait()
+        Empty,
+        Closed,
+    };
+
+    // Ctor
+    OutboundQueue(Strand strand, const OutboundConfig& config)
+        : m_config(config)
+        , m_signal(std::move(strand)) {}
+    // Copy
+    OutboundQueue(OutboundQueue const&) = delete;
+    OutboundQueue& operator=(OutboundQueue const&) = delete;
+    // Move
+    OutboundQueue(OutboundQueue&&) = delete;
+    OutboundQueue& operator=(OutboundQueue&&) = delete;
+    // Dtor
+    ~OutboundQueue() = default;
+
+    // Frames are classified by their message type
+    PushResult push(Frame&& frame) {
+        const auto priority = frame->empty()
+                                  ? FramePriority::Bulk
+                                  : priority_of(MessageType((*frame)[0]));
+        return push(std::move(frame), priority);
+    }
+
+    PushResult push(Frame&& frame, FramePriority priority) {
+        std::lock_guard lock(m_mutex);
+        if (m_closed) {
+            return PushResult::Dropped;
+        }
+
+        const std::size_t frame_size = frame->size();
+        // Control frames keep the session alive and are never dropped, the
+        // watermarks only apply to the other classes
+        if (priority != FramePriority::Control) {
+            if (const auto rejected = overflow_locked(frame_size)) {
+                return *rejected;
+            }
+        }
+
+        m_depth_bytes += frame_size;
+        m_classes[std::size_t(priority)].frames.push_back(std::move(frame));
+        notify_locked();
+        return PushResult::Queued;
+    }
+
+    // Moves the next batch into 'out' if at least one frame is queued, or
+    // wake() was called
+    PopResult pop_batch(std::vector<Slice>& out) {
+        std::lock_guard lock(m_mutex);
+        if (m_closed) {
+            return PopResult::Closed;
+        }
+        if (empty_locked() && !m_woken) {
+            m_waiting = true;
+            m_signal.expires_at(StrandTimer::time_point::max());
+            return PopResult::Empty;
+        }
+
+        m_woken = false;
+        out.clear();
+        std::size_t batch_size = 0;
+        while (batch_size < max_batch_size && !empty_locked()) {
+            for (std::size_t i = 0; i < frame_priority_count; ++i) {
+                batch_size += schedule_locked(i, out);
+            }
+        }
+        if (m_congested && m_config.policy != OverflowPolicy::DropNewest) {
+            m_congested = false;
+        }
+        return PopResult::Batch;
+    }
+
+    // Completes, with an asio::error_code, once pop_batch() has something
+    // to return after it returned Empty
+    template<typename CompletionToken>
+    decltype(auto) async_wait(CompletionToken&& token) {
+        return m_signal.async_wait(std::forward<CompletionToken>(token));
+    }
+
+    // Called by the writer once a batch was written, 'size' being the bytes
+    // that went on the wire
+    void record_sent(std::size_t size) {
+        std::lock_guard lock(m_mutex);
+        m_stats.bytes_sent += size;
+    }
+
+    void close() {
+        std::lock_guard lock(m_mutex);
+        close_locked();
+    }
+
+    // Called once the peer advertised it reassembles Fragment frames
+    void enable_fragments() {
+        std::lock_guard lock(m_mutex);
+        m_fragment_size = m_config.fragment_size;
+    }
+
+    // Makes the pending (or next) pop_batch() return even if no frame is
+    // queued, for the writer to send data that doesn't go through the queue
+    void wake() {
+        std::lock_guard lock(m_mutex);
+        m_woken = true;
+        notify_locked();
+    }
+
+    [[nodiscard]] bool closed() const {
+        std::lock_guard lock(m_mutex);
+        return m_closed;
+    }
+
+    [[nodiscard]] bool congested() const {
+        std::lock_guard lock(m_mutex);
+        return m_congested;
+    }
+
+    [[nodiscard]] OutboundStats stats() const {
+        std::lock_guard lock(m_mutex);
+        OutboundStats result = m_stats;
+        for (const auto& priority_class : m_classes) {
+            result.depth_frames += priority_class.frames.size();
+        }
+        result.depth_bytes = m_depth_bytes;
+        return result;
+    }
+
+private:
+    struct PriorityClass {
+        RingQueue<Frame> frames;
+        // Bytes of the front frame already sent as fragments
+        std::size_t sent = 0;
+        // Bytes the class may still send, see schedule_locked()
+        std::size_t deficit = 0;
+    };
+
+    [[nodiscard]] bool empty_locked() const {
+        return std::ranges::all_of(m_classes, [](const auto& priority_class) {
+            return priority_class.frames.empty();
+        });
+    }
+
+    // One deficit round robin turn of a class: appends its slices to 'out'
+    // and returns their size
+    std::size_t schedule_locked(std::size_t index, std::vector<Slice>& out) {
+        auto& priority_class = m_classes[index];
+        auto& frames = priority_class.frames;
+        if (frames.empty()) {
+            return 0;
+        }
+
+        priority_class.deficit += weights[index] * quantum;
+        std::size_t scheduled = 0;
+        while (!frames.empty()) {
+            const auto frame_size = frames.front()->size();
+            const auto remaining = frame_size - priority_class.sent;
+            const bool fragment =
+                m_fragment_size > 0 &&
+                (priority_class.sent > 0 || frame_size > m_fragment_size);
+            const auto size =
+                fragment ? std::min(remaining, m_fragment_size) : remaining;
+            if (size > priority_class.deficit) {
+                break;
+            }
+
+            Slice slice{
+                .frame = frames.front(),
+                .offset = priority_class.sent,
+                .size = size,
+                .fragment = fragment,
+            };
+            if (fragment) {
+                Fragment::encode_header(
+                    std::uint8_t(index),
+                    size == remaining,
+                    size,
+                    slice.header.data()
+                );
+            }
+            out.push_back(std::move(slice));
+
+            priority_class.deficit -= size;
+            scheduled += size;
+            m_depth_bytes -= size;
+            if (size == remaining) {
+                frames.pop_front();
+                priority_class.sent = 0;
+                ++m_stats.frames_sent;
+            }
+            else {
+                priority_class.sent += size;
+            }
+        }
+        // An idle class doesn't save up credit
+        if (frames.empty()) {
+            priority_class.deficit = 0;
+        }
+        return scheduled;
+    }
+
+    // Applies the overflow policy before queuing a frame of 'frame_size'
+    // bytes. Returns the result of the push if the frame must not be queued.
+    std::optional<PushResult> overflow_locked(std::size_t frame_size) {
+        if (m_depth_bytes + frame_size > m_config.high_watermark) {
+            if (!m_congested) {
+                m_congested = true;
+                ++m_stats.high_watermark_hits;
+            }
+            switch (m_config.policy) {
+                case OverflowPolicy::DropNewest: {
+                    ++m_stats.frames_dropped;
+                    return PushResult::Dropped;
+                }
+                case OverflowPolicy::DropOldest: {
+                    while (m_depth_bytes + frame_size >
+                               m_config.low_watermark &&
+                           evict_oldest_locked()) {
+                        ++m_stats.frames_dropped;
+                    }
+                    break;
+                }
+                case OverflowPolicy::Disconnect: {
+                    close_locked();
+                    return PushResult::Disconnect;
+                }
+            }
+        }
+        else if (m_congested && m_config.policy == OverflowPolicy::DropNewest) {
+            // Hysteresis: keep dropping until the writer catches up
+            if (m_depth_bytes > m_config.low_watermark) {
+                ++m_stats.frames_dropped;
+                return PushResult::Dropped;
+            }
+            m_congested = false;
+        }
+        return std::nullopt;
+    }
+
+    // Drops the oldest frame of the least urgent class, control frames are
+    // never evicted. A frame partly sent as fragments is kept, the peer is
+    // waiting for the rest of it.
+    bool evict_oldest_locked() {
+        for (const auto priority :
+             { FramePriority::Bulk, FramePriority::Interactive }) {
+            auto& priority_class = m_classes[std::size_t(priority)];
+            if (priority_class.frames.empty() || priority_class.sent > 0) {
+                continue;
+            }
+            m_depth_bytes -= priority_class.frames.front()->size();
+            priority_class.frames.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void close_locked() {
+        m_closed = true;
+        for (auto& priority_class : m_classes) {
+            priority_class.frames.clear();
+            priority_class.sent = 0;
+            priority_class.deficit = 0;
+        }
+        m_depth_bytes = 0;
+        notify_locked();
+    }
+
+    // The timer is not thread safe, so the wakeup is posted to the writer's
+    // strand. At most one wakeup is in flight per wait, its memory is reused.
+    void notify_locked() {
+        if (m_waiting) {
+            m_waiting = false;
+            asio::post(
+                m_signal.get_executor(),
+                bind_memory(m_notify_memory, [this] { m_signal.cancel(); })
+            );
+        }
+    }
+
+    OutboundConfig m_config;
+    StrandTimer m_signal;
+    HandlerMemory m_notify_memory;
+    mutable std::mutex m_mutex;
+    std::array<PriorityClass, frame_priority_count> m_classes;
+    // Bytes queued and not scheduled yet
+    std::size_t m_depth_bytes = 0;
+    // 0 until the peer accepts fragments
+    std::size_t m_fragment_size = 0;
+    bool m_waiting = false;
+    bool m_woken = false;
+    bool m_congested = false;
+    bool m_closed = false;
+    OutboundStats m_stats;
+};
+
+} // namespace peppe
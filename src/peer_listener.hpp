@@ -1,10 +1,22 @@
 #pragma once
 
+#include "control_server.hpp"
+#include "dialer.hpp"
+#include "discovery.hpp"
 #include "events.hpp"
+#include "local_socket.hpp"
+#include "logger.hpp"
+#include "metrics_server.hpp"
 #include "peer_session.hpp"
 #include "peer_table.hpp"
+#include "text_batcher.hpp"
 
+#include <asio/local/stream_protocol.hpp>
 #include <asio/read_until.hpp>
+#include <asio/strand.hpp>
+#include <atomic>
+#include <filesystem>
+#include <functional>
 #include <memory>
 #include <optional>
 
@@ -15,86 +27,280 @@ public:
     // Ctor
     PeerListener(asio::io_context& io_context, PeerTable&& table)
         : m_io_context(io_context)
+        , m_batcher(
+              asio::make_strand(io_context), m_connection_table, m_gossip
+          )
         , m_initial_peers(std::move(table)) {}
 
     // Dtor
-    ~PeerListener() = default;
+    ~PeerListener() {
+        if (!m_unix_socket.empty()) {
+            std::error_code ignored;
+            std::filesystem::remove(m_unix_socket, ignored);
+        }
+        const auto& stats = m_gossip.stats();
+        log_info(
+            "Gossip: originated: {} received: {} duplicates: {} forwarded: {} "
+            "amplification: {:.2f}",
+            stats.originated.load(std::memory_order_relaxed),
+            stats.received.load(std::memory_order_relaxed),
+            stats.duplicates.load(std::memory_order_relaxed),
+            stats.forwarded.load(std::memory_order_relaxed),
+            stats.amplification()
+        );
+    }
 
     void set_port(asio::ip::port_type port) { m_port = port; }
-    void set_client_name(const std::string& name) { m_client_name = name; }
+    // Also accept peers on this Unix domain socket, empty disables it
+    void set_unix_socket(const std::string& path) { m_unix_socket = path; }
+    void set_client_name(const std::string& name) {
+        m_client_name = name;
+        m_batcher.set_origin(name);
+    }
+    void set_outbound_config(const OutboundConfig& config) {
+        m_session_config.outbound = config;
+    }
+    void set_compression_config(const CompressionConfig& config) {
+        m_session_config.compression = config;
+    }
+    void set_heartbeat_config(const HeartbeatConfig& config) {
+        m_session_config.heartbeat = config;
+    }
+    void set_file_transfer_config(const FileTransferConfig& config) {
+        m_session_config.files = config;
+    }
+    void set_batch_config(const BatchConfig& config) {
+        m_batcher.set_config(config);
+    }
+    void set_gossip_config(const GossipConfig& config) {
+        m_gossip.set_config(config);
+    }
+    void set_dial_config(const DialConfig& config) { m_dial_config = config; }
+    void set_discovery_config(const DiscoveryConfig& config) {
+        m_discovery.set_config(config);
+    }
+    // 0 disables the metrics endpoint
+    void set_metrics_port(asio::ip::port_type port) { m_metrics_port = port; }
+    // Empty disables the control socket
+    void set_control_socket(const std::string& path) {
+        m_control_socket = path;
+    }
 
     void on_event(const FrontendEvent& event) override {
         event.match(
             [this](const SendMessage& sm) {
-                m_connection_table.send_all(
-                    Packet::text_message(std::string(sm.message))
-                );
+                m_batcher.push(sm.message);
+            },
+            [this](const SendFile& sf) {
+                const auto source = FileSource::open(sf.path);
+                if (source == nullptr) {
+                    log_error("Can't read '{}'", sf.path);
+                    return;
+                }
+                const auto peers = m_connection_table.offer_file(source);
+                log_info("Offered '{}' to {} peers", source->name(), peers);
             },
             [](const Terminate& t) {}
         );
     }
 
-    awaitable<void>
-    connect_to_peer(tcp::socket&& socket, tcp::endpoint&& endpoint) {
-        // fmt::print(stderr, "connect_to_peer() IN\n");
-        auto [error] =
-            co_await socket.async_connect(endpoint, use_nothrow_awaitable);
-        if (error) {
-            // error.message());
-            co_return;
+    // Dials a peer on a new strand and starts its session. 'on_close' is
+    // called when the session ends, it isn't when the dial fails.
+    awaitable<bool> connect_to_peer(
+        const Peer& peer,
+        std::function<void()> on_close = {}
+    ) {
+        // Every session runs on its own strand
+        const Strand strand = asio::make_strand(m_io_context);
+        if (peer.is_local()) {
+            auto socket = co_await co_spawn(
+                strand, dial_local(strand, peer, m_dial_config), use_awaitable
+            );
+            co_return co_await start_session<asio::local::stream_protocol>(
+                std::move(socket), std::move(on_close)
+            );
         }
-
-        auto self_shared = std::make_shared<PeerSession>(
-            m_connection_table, std::move(socket), m_client_name
+        auto socket = co_await co_spawn(
+            strand, dial(strand, peer, m_dial_config), use_awaitable
+        );
+        co_return co_await start_session<tcp>(
+            std::move(socket), std::move(on_close)
         );
-        co_await self_shared->start();
-        co_return;
     }
 
+    // Dials every initial peer in parallel, at most 'max_concurrent' at a
+    // time
     awaitable<void> connect_to_peers() {
-
-        if (m_initial_peers.size() > 0) {
-            for (auto& peer : m_initial_peers) {
-                // Create socket and connect
-                auto endpoint = tcp::endpoint(peer.address, peer.port);
-                auto socket = tcp::socket(m_io_context, endpoint.protocol());
-
-                // TODO: Add a timeout to the connection attempt
-                // so I cant try to connect to all at once
-                // co_spawn(
-                //     m_io_context,
-                //     connect_to_peer(std::move(tmp.value()),
-                //     std::move(endpoint)), detached);
-                co_await connect_to_peer(
-                    std::move(socket), std::move(endpoint)
-                );
-            }
+        if (m_initial_peers.empty()) {
+            co_return;
         }
 
-        co_return;
+        auto progress = std::make_shared<DialProgress>();
+        const auto workers =
+            std::min(m_dial_config.max_concurrent, m_initial_peers.size());
+        progress->workers = workers;
+        for (std::size_t i = 0; i < workers; ++i) {
+            co_spawn(m_io_context, dial_worker(progress), detached);
+        }
     }
 
     awaitable<void> listener() {
         // Try to connect to known peers
         co_spawn(m_io_context, connect_to_peers(), detached);
+        if (m_metrics_port != 0) {
+            co_spawn(
+                m_io_context, m_metrics_server.listen(m_metrics_port), detached
+            );
+        }
+        if (m_discovery.config().enabled) {
+            co_spawn(
+                m_discovery_strand,
+                m_discovery.run(
+                    m_gossip.node_id(),
+                    m_port,
+                    m_client_name.value_or(""),
+                    [this](const Peer& peer, std::uint64_t node_id) {
+                        co_spawn(
+                            m_io_context,
+                            [this, peer, node_id] {
+                                return dial_discovered(peer, node_id);
+                            },
+                            detached
+                        );
+                    }
+                ),
+                detached
+            );
+        }
+        if (!m_control_socket.empty()) {
+            co_spawn(
+                m_io_context,
+                m_control_server.listen(m_control_socket),
+                detached
+            );
+        }
+
+        if (!m_unix_socket.empty() && !remove_stale_socket(m_unix_socket)) {
+            log_error("Not listening on '{}'", m_unix_socket);
+            // Not ours to remove either
+            m_unix_socket.clear();
+        }
+        if (!m_unix_socket.empty()) {
+            using local = asio::local::stream_protocol;
+            local::acceptor acceptor(
+                m_io_context, local::endpoint(m_unix_socket)
+            );
+            log_info("Listening on '{}'", m_unix_socket);
+            co_spawn(
+                m_io_context,
+                accept_peers<local>(std::move(acceptor)),
+                detached
+            );
+        }
 
         tcp::acceptor acceptor(m_io_context, { tcp::v4(), m_port });
-        fmt::print(stderr, "Listening on port '{}'\n", m_port);
+        log_info("Listening on port '{}'", m_port);
+        co_await accept_peers<tcp>(std::move(acceptor));
+    }
 
+private:
+    template<typename Protocol>
+    awaitable<bool> start_session(
+        std::optional<StrandSocket<Protocol>> socket,
+        std::function<void()> on_close
+    ) {
+        if (!socket.has_value()) {
+            co_return false;
+        }
+        auto self_shared = std::make_shared<BasicPeerSession<Protocol>>(
+            m_connection_table,
+            m_gossip,
+            std::move(*socket),
+            m_client_name,
+            m_session_config
+        );
+        self_shared->set_on_close(std::move(on_close));
+        self_shared->start();
+        co_return true;
+    }
+
+    // Starts a session, on its own strand, for every peer connecting
+    // through 'acceptor'
+    template<typename Protocol>
+    awaitable<void> accept_peers(typename Protocol::acceptor acceptor) {
         while (true) {
-            auto socket = co_await acceptor.async_accept(use_awaitable);
-            auto self_shared = std::make_shared<PeerSession>(
-                m_connection_table, std::move(socket), m_client_name
+            auto socket = co_await acceptor.async_accept(
+                asio::make_strand(m_io_context), use_awaitable
+            );
+            auto session = std::make_shared<BasicPeerSession<Protocol>>(
+                m_connection_table,
+                m_gossip,
+                std::move(socket),
+                m_client_name,
+                m_session_config
+            );
+            session->start();
+        }
+    }
+
+    // Discovery dials the node again once it is forgotten, when the dial
+    // fails or the session ends
+    awaitable<void> dial_discovered(Peer peer, std::uint64_t node_id) {
+        auto forget = [this, node_id] { m_discovery.forget(node_id); };
+        if (!co_await connect_to_peer(peer, forget)) {
+            forget();
+        }
+    }
+
+    struct DialProgress {
+        std::atomic<std::size_t> next = 0;
+        std::atomic<std::size_t> connected = 0;
+        std::atomic<std::size_t> workers = 0;
+        steady_clock::time_point start = steady_clock::now();
+    };
+
+    awaitable<void> dial_worker(std::shared_ptr<DialProgress> progress) {
+        while (true) {
+            const auto index = progress->next.fetch_add(1);
+            if (index >= m_initial_peers.size()) {
+                break;
+            }
+            if (co_await connect_to_peer(m_initial_peers[index])) {
+                progress->connected.fetch_add(1);
+            }
+        }
+
+        if (progress->workers.fetch_sub(1) == 1) {
+            const auto elapsed = steady_clock::now() - progress->start;
+            log_info(
+                "Connected to {}/{} initial peers in {} ms",
+                progress->connected.load(),
+                m_initial_peers.size(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)
+                    .count()
             );
-            co_spawn(socket.get_executor(), self_shared->start(), detached);
         }
     }
 
-private:
     asio::io_context& m_io_context;
     std::optional<std::string> m_client_name = std::nullopt;
     asio::ip::port_type m_port = 2501;
+    std::string m_unix_socket;
+    SessionConfig m_session_config;
+    DialConfig m_dial_config;
     ConnectionTable m_connection_table;
+    Gossip m_gossip;
+    asio::ip::port_type m_metrics_port = 0;
+    MetricsServer m_metrics_server{ m_connection_table, m_gossip };
+    TextBatcher m_batcher;
+    std::string m_control_socket;
+    asio::strand<asio::io_context::executor_type> m_discovery_strand{
+        asio::make_strand(m_io_context)
+    };
+    Discovery m_discovery{ m_discovery_strand };
+    ControlServer m_control_server{ m_io_context,
+                                    m_connection_table,
+                                    m_batcher };
     PeerTable m_initial_peers;
 };
 
@@ -1,39 +1,93 @@
 #pragma once
 
 #include "asio/ip/address.hpp"
+#include "chat_message.hpp"
+#include "compression.hpp"
 #include "connection_table.hpp"
 #include "events.hpp"
+#include "file_transfer.hpp"
 #include "fmt/base.h"
+#include "frame_reader.hpp"
+#include "gossip.hpp"
+#include "heartbeat.hpp"
+#include "logger.hpp"
 #include "message.hpp"
+#include "metrics.hpp"
 
+#include <asio/dispatch.hpp>
+#include <asio/local/stream_protocol.hpp>
 #include <asio/use_future.hpp>
+#include <chrono>
 #include <fmt/core.h>
+#include <functional>
 #include <ranges>
+#include <span>
+#include <type_traits>
 
 namespace peppe {
 
-class PeerSession : public std::enable_shared_from_this<PeerSession> {
+// Settings shared by every session
+struct SessionConfig {
+    OutboundConfig outbound;
+    CompressionConfig compression;
+    HeartbeatConfig heartbeat;
+    FileTransferConfig files;
+};
+
+// Session over any stream transport: TCP, or Unix domain sockets for peers
+// on the same host
+template<typename Protocol>
+class BasicPeerSession
+    : public std::enable_shared_from_this<BasicPeerSession<Protocol>> {
 public:
+    using socket_type = StrandSocket<Protocol>;
+
     // Ctor
-    PeerSession(
+    BasicPeerSession(
         ConnectionTable& conn_table,
-        tcp::socket socket,
-        const std::optional<std::string>& client_name_opt
+        Gossip& gossip,
+        socket_type socket,
+        const std::optional<std::string>& client_name_opt,
+        const SessionConfig& config
     )
-        : m_connection{ std::nullopt, std::move(socket) }
-        , m_connection_table_ref(conn_table) {
-        m_connection_table_ref.add(&m_connection);
-        const auto ep = m_connection.socket.remote_endpoint();
-        fmt::print(
-            stderr, "Connected ({}:{})\n", ep.address().to_string(), ep.port()
-        );
+        : m_socket(std::move(socket))
+        , m_connection{ m_socket.get_executor(), config.outbound }
+        , m_connection_table_ref(conn_table)
+        , m_gossip_ref(gossip)
+        , m_heartbeat_config(config.heartbeat)
+        , m_heartbeat_timer(m_socket.get_executor())
+        , m_compression_config(config.compression)
+        , m_compressor(config.compression.level) {
+        m_connection.files.set_config(config.files);
+        m_incoming_files.set_config(config.files);
+        limit_unsent_bytes(m_socket);
+        auto info = peer_info(m_socket);
+        m_address = info.address;
+        m_handle = m_connection_table_ref.add(&m_connection, std::move(info));
+        log_info("Connected ({})", m_address);
         EventManager::send(BackendEvent{ PeerConnected{} });
 
-        // When the session starts, the first packet sent is set name
+        // When the session starts, the first packet sent advertises our
+        // capabilities, then comes set name
+        const bool compression =
+            m_compression_config.enabled && compression_supported();
+        m_connection.outbound.push(
+            Packet::capabilities(
+                Capabilities::Fragments |
+                    (compression
+                         ? std::uint32_t(Capabilities::StreamCompression)
+                         : 0U),
+                m_gossip_ref.node_id()
+            )
+                .encode_shared()
+        );
+
         if (client_name_opt.has_value()) {
-            Packet::set_name(std::string(client_name_opt.value()))
-                .write(m_connection.socket);
-            fmt::print(stderr, "Sent SetName\n");
+            m_connection.outbound.push(
+                Packet::set_name(std::string(client_name_opt.value()))
+                    .encode_shared()
+            );
+            log_debug("Sent SetName");
         }
 
         // Also send known peers
@@ -51,83 +105,614 @@ public:
                 return addr.to_v6().to_bytes();
             });
 
-        Packet::peer_discovery(ivp4_addresses_bytes, ivp6_addresses_bytes)
-            .write(m_connection.socket);
-        fmt::print(stderr, "Sent PeerDiscovery\n");
+        m_connection.outbound.push(
+            Packet::peer_discovery(ivp4_addresses_bytes, ivp6_addresses_bytes)
+                .encode_shared()
+        );
+        log_debug("Sent PeerDiscovery");
     }
 
     // Dtor
-    ~PeerSession() {
-        m_connection_table_ref.remove(&m_connection);
-        const auto ep = m_connection.socket.remote_endpoint();
-        fmt::print(
-            stderr,
-            "Disconnected ({}:{})\n",
-            ep.address().to_string(),
-            ep.port()
+    ~BasicPeerSession() {
+        m_connection_table_ref.remove(m_handle);
+        if (m_on_close) {
+            m_on_close();
+        }
+        const auto& inbound = m_connection.inbound;
+        log_info(
+            "Disconnected ({}) frames: {} reads: {} bytes: {}",
+            m_address,
+            inbound.frames.load(std::memory_order_relaxed),
+            inbound.reads.load(std::memory_order_relaxed),
+            inbound.bytes.load(std::memory_order_relaxed)
         );
+        const auto& compression = m_connection.compression;
+        if (compression.compressed_writes.load(std::memory_order_relaxed) > 0) {
+            log_info(
+                "Compression ratio: {:.2f} ({} us compressing, {} us "
+                "decompressing)",
+                compression.ratio(),
+                compression.compress_ns.load(std::memory_order_relaxed) / 1000,
+                compression.decompress_ns.load(std::memory_order_relaxed) /
+                    1000
+            );
+        }
         EventManager::send(BackendEvent{ PeerDisconnected{} });
     }
 
-    awaitable<void> start() {
-        co_spawn(
-            m_connection.socket.get_executor(),
-            [self = shared_from_this()] { return self->reader(); },
-            detached
+    // Called once the session has ended
+    void set_on_close(std::function<void()> on_close) {
+        m_on_close = std::move(on_close);
+    }
+
+    // The reader, the writer and the heartbeat are chains of callbacks on
+    // the session's strand, each holding a reference to the session. Every
+    // operation of a chain reuses the memory of the previous one.
+    void start() {
+        asio::dispatch(
+            m_socket.get_executor(),
+            [self = this->shared_from_this()] {
+                self->read();
+                self->write();
+                if (self->m_heartbeat_config.interval.count() > 0) {
+                    self->heartbeat();
+                }
+            }
         );
+    }
 
-        co_return;
+private:
+    void read() {
+        m_socket.async_read_some(
+            m_frame_reader.prepare(),
+            bind_memory(
+                m_read_memory,
+                [self = this->shared_from_this()](
+                    const asio::error_code& err,
+                    std::size_t len
+                ) { self->on_read(err, len); }
+            )
+        );
     }
 
-    awaitable<void> reader() {
+    void on_read(const asio::error_code& err, std::size_t len) {
         try {
-            while (true) {
-                auto packet = co_await Packet::read(m_connection.socket);
-                const auto ep = m_connection.socket.remote_endpoint();
-                auto from = m_connection.name.value_or(
-                    fmt::format("{}:{}", ep.address().to_string(), ep.port())
-                );
-
-                packet.match(
-                    [&from](TextMessage& text_msg) {
-                        fmt::print(stderr, "'{}' > {}\n", from, text_msg.text);
-                        EventManager::send(BackendEvent{
-                            ReceiveMessage{ from, text_msg.text } });
-                    },
-                    [this](SetName& set_name) {
-                        m_connection.name = set_name.name;
-                    },
-                    [](PeerDiscovery& peer_discovery) {
-                        fmt::print(
-                            stderr,
-                            "IPv4 Addresses ({}):\n",
-                            peer_discovery.ipv4_addresses.size()
-                        );
-                        for (const auto& address :
-                             peer_discovery.ipv4_addresses) {
-                            fmt::print(
-                                stderr,
-                                "{}.{}.{}.{}\n",
-                                address[0],
-                                address[1],
-                                address[2],
-                                address[3]
-                            );
-                        }
-                    },
-                    // Default case
-                    [](auto&&) {}
-                );
+            if (err) {
+                throw ConnectionClosed();
             }
+            handle_read(len);
+            read();
+            return;
         }
         catch (ConnectionClosed&) {
             // fmt::print(stderr, "ConnectionClosed\n");
         }
+        catch (UnknownMsg&) {
+            Metrics::global().protocol_errors.add();
+            log_warn("Received unknown message type");
+        }
+        // Wake up the writer so it releases the session
+        m_connection.outbound.close();
     }
 
-private:
+    void handle_read(std::size_t len) {
+        m_frame_reader.commit(len);
+        m_connection.inbound.reads.fetch_add(1, std::memory_order_relaxed);
+        m_connection.inbound.bytes.fetch_add(len, std::memory_order_relaxed);
+
+        // Decode every complete frame received so far, then handle them.
+        // Decoding is timed once per read.
+        const auto decode_start = steady_clock::now();
+        while (auto packet = m_frame_reader.next()) {
+            m_decoded.push_back(std::move(*packet));
+        }
+        if (m_decoded.empty()) {
+            return;
+        }
+        Metrics::global().decode_ns.record(steady_clock::now() - decode_start);
+        m_connection.inbound.frames.fetch_add(
+            m_decoded.size(), std::memory_order_relaxed
+        );
+        for (auto& packet : m_decoded) {
+            on_packet(packet);
+        }
+        m_decoded.clear();
+    }
+
+    // Drains the outbound queue. Every batch scheduled by the queue is sent
+    // with a single gathered write, compressed when negotiated.
+    // File chunks are sent in between, one per batch: frames queued during
+    // a transfer wait for a single chunk at most.
+    void write() {
+        switch (m_connection.outbound.pop_batch(m_slices)) {
+            case OutboundQueue::PopResult::Batch: {
+                write_frames();
+                break;
+            }
+            case OutboundQueue::PopResult::Empty: {
+                m_connection.outbound.async_wait(bind_memory(
+                    m_write_memory,
+                    [self = this->shared_from_this()](const asio::error_code&) {
+                        self->write();
+                    }
+                ));
+                break;
+            }
+            case OutboundQueue::PopResult::Closed: {
+                stop_writer();
+                break;
+            }
+        }
+    }
+
+    void write_frames() {
+        if (m_slices.empty()) {
+            // Woken up to send a file chunk
+            on_written({}, 0);
+            return;
+        }
+        m_buffers.clear();
+        std::size_t total_size = 0;
+        for (const auto& slice : m_slices) {
+            const auto header = slice.header_bytes();
+            if (!header.empty()) {
+                m_buffers.emplace_back(header.data(), header.size());
+            }
+            const auto bytes = slice.bytes();
+            m_buffers.emplace_back(bytes.data(), bytes.size());
+            total_size += slice.wire_size();
+        }
+
+        if (m_compress) {
+            if (total_size >= m_compression_config.threshold) {
+                compress(m_slices, total_size);
+                m_buffers.assign({ asio::buffer(m_compressed) });
+            }
+            else {
+                m_connection.compression.skipped_writes.fetch_add(
+                    1, std::memory_order_relaxed
+                );
+            }
+        }
+
+        // A span, asio would copy the vector
+        asio::async_write(
+            m_socket,
+            std::span<const asio::const_buffer>(m_buffers),
+            bind_memory(
+                m_write_memory,
+                [self = this->shared_from_this()](
+                    const asio::error_code& err,
+                    std::size_t len
+                ) { self->on_written(err, len); }
+            )
+        );
+    }
+
+    void on_written(const asio::error_code& err, std::size_t len) {
+        // Release our references to the shared frames
+        m_slices.clear();
+        if (err) {
+            stop_writer();
+            return;
+        }
+        m_connection.outbound.record_sent(len);
+        auto chunk = m_connection.files.next_chunk();
+        if (!chunk.has_value()) {
+            write();
+            return;
+        }
+        co_spawn(
+            m_socket.get_executor(),
+            write_chunk(std::move(*chunk)),
+            [self = this->shared_from_this()](std::exception_ptr, bool sent) {
+                if (!sent) {
+                    self->stop_writer();
+                    return;
+                }
+                // Come back for the next chunk once queued frames are sent
+                self->m_connection.outbound.wake();
+                self->write();
+            }
+        );
+    }
+
+    // Unblocks the reader so it releases the session
+    void stop_writer() {
+        m_connection.outbound.close();
+        asio::error_code ignored;
+        m_socket.shutdown(socket_type::shutdown_both, ignored);
+        m_socket.close(ignored);
+        // Don't keep the session alive until the next ping
+        m_heartbeat_timer.cancel();
+    }
+
+    // Writes a FileChunk frame, its data straight from the file. Chunks are
+    // never compressed.
+    awaitable<bool> write_chunk(FileChunkJob chunk) {
+        std::array<std::uint8_t, FileChunk::header_size> header{};
+        FileChunk::encode_header(
+            chunk.source->id(), chunk.offset, chunk.size, header.data()
+        );
+        auto [err, len] = co_await asio::async_write(
+            m_socket, asio::buffer(header), use_nothrow_awaitable
+        );
+        if (err) {
+            co_return false;
+        }
+        co_return co_await send_file_range(
+            m_socket, chunk.source->fd(), chunk.offset, chunk.size
+        );
+    }
+
+    // Pings the peer every interval. A half-open connection never errors
+    // on read, so the peer is evicted once too many pings went unanswered.
+    void heartbeat() {
+        if (m_connection.outbound.closed()) {
+            return;
+        }
+        m_heartbeat_timer.expires_after(m_heartbeat_config.interval);
+        m_heartbeat_timer.async_wait(bind_memory(
+            m_heartbeat_memory,
+            [self = this->shared_from_this()](const asio::error_code&) {
+                self->on_heartbeat();
+            }
+        ));
+    }
+
+    void on_heartbeat() {
+        if (m_connection.outbound.closed()) {
+            return;
+        }
+        if (m_missed_pings >= m_heartbeat_config.max_missed) {
+            log_warn("No heartbeat from {}, disconnecting", m_address);
+            // The reader and the writer fail and release the session
+            m_connection.outbound.close();
+            asio::error_code ignored;
+            m_socket.shutdown(socket_type::shutdown_both, ignored);
+            m_socket.close(ignored);
+            return;
+        }
+        ++m_missed_pings;
+        m_connection.outbound.push(
+            Packet::ping(std::uint64_t(now_us().count())).encode_shared()
+        );
+        heartbeat();
+    }
+
+    [[nodiscard]] static PeerInfo peer_info(const socket_type& socket) {
+        asio::error_code ignored;
+        const auto remote = socket.remote_endpoint(ignored);
+        if constexpr (std::is_same_v<Protocol, tcp>) {
+            return PeerInfo{
+                .address = fmt::format(
+                    "{}:{}", remote.address().to_string(), remote.port()
+                ),
+                .ip = remote.address(),
+            };
+        }
+        else {
+            // The connecting end is usually unnamed, name it after the
+            // listening socket
+            auto path = remote.path();
+            if (path.empty()) {
+                path = socket.local_endpoint(ignored).path();
+            }
+            return PeerInfo{ .address = fmt::format("unix:{}", path) };
+        }
+    }
+
+    // Bytes waiting in the kernel send buffer are out of reach of the
+    // outbound queue's scheduling, a control frame would queue behind them.
+    // Keeping about one batch there doesn't cost throughput.
+    static void limit_unsent_bytes([[maybe_unused]] socket_type& socket) {
+#if defined(TCP_NOTSENT_LOWAT)
+        if constexpr (std::is_same_v<Protocol, tcp>) {
+            const int bytes = int(OutboundQueue::max_batch_size);
+            ::setsockopt(
+                socket.native_handle(),
+                IPPROTO_TCP,
+                TCP_NOTSENT_LOWAT,
+                &bytes,
+                sizeof(bytes)
+            );
+        }
+#endif
+    }
+
+    [[nodiscard]] static std::chrono::microseconds now_us() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            steady_clock::now().time_since_epoch()
+        );
+    }
+
+    void on_pong(const Pong& pong) {
+        const auto sample =
+            now_us() - std::chrono::microseconds(std::int64_t(pong.value));
+        if (sample.count() < 0) {
+            // Not one of our pings
+            return;
+        }
+        m_missed_pings = 0;
+        m_rtt.add_sample(sample);
+        m_connection_table_ref.set_rtt(m_handle, *m_rtt.srtt());
+    }
+
+    // Compresses 'slices' into a single Compressed frame in m_compressed
+    void compress(
+        const std::vector<OutboundQueue::Slice>& slices,
+        std::size_t total_size
+    ) {
+        const auto start = std::chrono::steady_clock::now();
+        m_compressed.resize(Compressed::header_size);
+        for (std::size_t i = 0; i < slices.size(); ++i) {
+            const auto header = slices[i].header_bytes();
+            if (!header.empty()) {
+                m_compressor.compress(header, m_compressed, false);
+            }
+            m_compressor.compress(
+                slices[i].bytes(), m_compressed, i + 1 == slices.size()
+            );
+        }
+        const auto payload_size = m_compressed.size() - Compressed::header_size;
+        Compressed::encode_header(payload_size, m_compressed.data());
+
+        auto& stats = m_connection.compression;
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        stats.compress_ns.fetch_add(
+            std::uint64_t(std::chrono::nanoseconds(elapsed).count()),
+            std::memory_order_relaxed
+        );
+        stats.raw_bytes.fetch_add(total_size, std::memory_order_relaxed);
+        stats.compressed_bytes.fetch_add(
+            m_compressed.size(), std::memory_order_relaxed
+        );
+        stats.compressed_writes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Handles the frames contained in a Compressed frame
+    void on_compressed(const Compressed& compressed) {
+        if (!m_compression_config.enabled || !compression_supported()) {
+            // Never advertised
+            throw ConnectionClosed();
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        m_decompressed.clear();
+        m_decompressor.decompress(
+            compressed.payload, m_decompressed, FrameReader::max_capacity
+        );
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        m_connection.compression.decompress_ns.fetch_add(
+            std::uint64_t(std::chrono::nanoseconds(elapsed).count()),
+            std::memory_order_relaxed
+        );
+
+        // The sender only compresses complete frames
+        ByteReader reader(m_decompressed);
+        while (reader.remaining() > 0) {
+            auto packet = Packet::decode(reader);
+            if (!packet.has_value() ||
+                std::holds_alternative<Compressed>(*packet)) {
+                throw ConnectionClosed();
+            }
+            on_packet(*packet);
+        }
+    }
+
+    // Appends the fragment to the partial frame of its stream, handles the
+    // frame once its last fragment arrived
+    void on_fragment(const Fragment& fragment) {
+        if (fragment.stream >= m_reassembly.size()) {
+            throw ConnectionClosed();
+        }
+        auto& buffer = m_reassembly[fragment.stream];
+        if (buffer.size() + fragment.data.size() > FrameReader::max_capacity) {
+            throw ConnectionClosed();
+        }
+        buffer.insert(buffer.end(), fragment.data.begin(), fragment.data.end());
+        if (fragment.last == 0) {
+            return;
+        }
+
+        // A fragment holds a single complete frame
+        ByteReader reader(buffer);
+        auto packet = Packet::decode(reader);
+        if (!packet.has_value() || reader.remaining() > 0 ||
+            std::holds_alternative<Compressed>(*packet) ||
+            std::holds_alternative<Fragment>(*packet)) {
+            throw ConnectionClosed();
+        }
+        on_packet(*packet);
+        buffer.clear();
+    }
+
+    static void on_file_progress(
+        const std::string& from,
+        const IncomingTransfers::Progress& progress
+    ) {
+        if (progress.completed_path.has_value()) {
+            log_info("Received '{}'", *progress.completed_path);
+            EventManager::send(BackendEvent{
+                ReceiveFile{ from, *progress.completed_path } });
+        }
+    }
+
+    // Drops the copies of already seen messages. The first one is written
+    // once into a shared message, forwarded as is to a few other peers and
+    // delivered.
+    template<typename Texts>
+    void relay(
+        const GossipHeader& header,
+        const std::string& from,
+        const Texts& texts
+    ) {
+        if (!m_gossip_ref.first_seen(header.id)) {
+            return;
+        }
+        const auto config = m_gossip_ref.config();
+        const bool forward = header.ttl > 1 && config.fanout > 0;
+        auto forwarded = header;
+        forwarded.ttl = forward ? header.ttl - 1 : 0;
+        auto message = ChatMessage::create(forwarded, from, texts);
+        if (forward) {
+            const auto sent = m_connection_table_ref.send_sample(
+                message->frame(), m_handle, config.fanout
+            );
+            m_gossip_ref.add_forwarded(sent);
+        }
+        for (const auto text : message->texts()) {
+            log_debug("'{}' > {}", message->sender(), text);
+        }
+        EventManager::send(BackendEvent{ ReceiveMessage{ std::move(message) } }
+        );
+    }
+
+    void on_packet(Packet& packet) {
+        const std::string& from =
+            m_connection.name.has_value() ? *m_connection.name : m_address;
+
+        packet.match(
+            [this, &from](TextMessage& text_msg) {
+                relay(
+                    text_msg.gossip,
+                    from,
+                    std::span<const std::string_view>(&text_msg.text, 1)
+                );
+            },
+            [this, &from](TextBatch& batch) {
+                relay(batch.gossip, from, batch.texts);
+            },
+            [this](SetName& set_name) {
+                m_connection_table_ref.set_name(m_handle, set_name.name);
+                m_connection.name = std::move(set_name.name);
+            },
+            [this](Capabilities& capabilities) {
+                m_connection_table_ref.set_node_id(
+                    m_handle, capabilities.node_id
+                );
+                m_compress = m_compression_config.enabled &&
+                             compression_supported() &&
+                             (capabilities.flags &
+                              Capabilities::StreamCompression) != 0;
+                if ((capabilities.flags & Capabilities::Fragments) != 0) {
+                    m_connection.outbound.enable_fragments();
+                }
+            },
+            [this](Compressed& compressed) { on_compressed(compressed); },
+            [this](Fragment& fragment) { on_fragment(fragment); },
+            [this](Ping& ping) {
+                m_connection.outbound.push(
+                    Packet::pong(ping.value).encode_shared()
+                );
+            },
+            [this](Pong& pong) { on_pong(pong); },
+            [this, &from](FileOffer& offer) {
+                const auto progress = m_incoming_files.offer(offer);
+                if (!progress.has_value()) {
+                    // Lets the sender release the file
+                    m_connection.outbound.push(
+                        Packet::file_decline(offer.transfer_id).encode_shared()
+                    );
+                    return;
+                }
+                log_info(
+                    "Receiving '{}' ({} bytes) from {}",
+                    offer.name,
+                    offer.size,
+                    from
+                );
+                m_connection.outbound.push(
+                    Packet::file_accept(offer.transfer_id, progress->offset)
+                        .encode_shared()
+                );
+                on_file_progress(from, *progress);
+            },
+            [this, &from](FileChunk& chunk) {
+                const auto progress = m_incoming_files.write(chunk);
+                if (!progress.has_value()) {
+                    return;
+                }
+                m_connection.outbound.push(
+                    Packet::file_ack(chunk.transfer_id, progress->offset)
+                        .encode_shared()
+                );
+                on_file_progress(from, *progress);
+            },
+            [this](FileAccept& accept) {
+                m_connection.files.accept(accept.transfer_id, accept.offset);
+                m_connection.outbound.wake();
+            },
+            [this](FileDecline& decline) {
+                m_connection.files.decline(decline.transfer_id);
+            },
+            [this](FileAck& ack) {
+                m_connection.files.ack(ack.transfer_id, ack.offset);
+                m_connection.outbound.wake();
+            },
+            [](PeerDiscovery& peer_discovery) {
+                log_debug(
+                    "IPv4 Addresses ({}):",
+                    peer_discovery.ipv4_addresses.size()
+                );
+                for (const auto& address :
+                     peer_discovery.ipv4_addresses) {
+                    log_debug(
+                        "{}.{}.{}.{}",
+                        address[0],
+                        address[1],
+                        address[2],
+                        address[3]
+                    );
+                }
+            },
+            // Default case
+            [](auto&&) {}
+        );
+    }
+
+    socket_type m_socket;
     PeerConnection m_connection;
     ConnectionTable& m_connection_table_ref;
+    Gossip& m_gossip_ref;
+    ConnectionHandle m_handle;
+    // Printable remote address, see PeerInfo
+    std::string m_address;
+    std::function<void()> m_on_close;
+    FrameReader m_frame_reader;
+    // Packets decoded from a read, their strings are views into the read
+    // buffer
+    std::vector<Packet> m_decoded;
+    HandlerMemory m_read_memory;
+
+    // Batch being written, only accessed from the session's strand
+    std::vector<OutboundQueue::Slice> m_slices;
+    std::vector<asio::const_buffer> m_buffers;
+    HandlerMemory m_write_memory;
+
+    // Heartbeat, only accessed from the session's strand
+    HeartbeatConfig m_heartbeat_config;
+    StrandTimer m_heartbeat_timer;
+    HandlerMemory m_heartbeat_memory;
+    std::size_t m_missed_pings = 0;
+    RttEstimator m_rtt;
+
+    // Negotiated stream compression
+    CompressionConfig m_compression_config;
+    bool m_compress = false;
+    StreamCompressor m_compressor;
+    StreamDecompressor m_decompressor;
+    std::vector<std::uint8_t> m_compressed;
+    std::vector<std::uint8_t> m_decompressed;
+
+    // Frames being received as fragments, one per priority class
+    std::array<std::vector<std::uint8_t>, frame_priority_count> m_reassembly;
+
+    // Files being received, the sent ones are in m_connection
+    IncomingTransfers m_incoming_files;
 };
 
+using PeerSession = BasicPeerSession<tcp>;
+using LocalPeerSession = BasicPeerSession<asio::local::stream_protocol>;
+
 } // namespace peppe
\ No newline at end of file
@@ -1,15 +1,32 @@
 #pragma once
 
-#include <asio/ip/address.hpp>
+#include <chrono>
+#include <cstddef>
+#include <string>
 #include <vector>
 
 namespace peppe {
 
 struct Peer {
-    asio::ip::address address;
-    int port;
+    // Address or host name
+    std::string host;
+    int port = 0;
+    // Unix domain socket of a peer on the same host. 'host' and 'port' are
+    // ignored when set.
+    std::string local_path = {};
+
+    [[nodiscard]] bool is_local() const { return !local_path.empty(); }
 };
 
 using PeerTable = std::vector<Peer>;
 
+struct DialConfig {
+    // Deadline of a single connection attempt
+    std::chrono::milliseconds connect_timeout = std::chrono::seconds(5);
+    // Peers dialed at the same time
+    std::size_t max_concurrent = 16;
+    // Head start of an address before the next one is tried (RFC 8305)
+    std::chrono::milliseconds attempt_delay = std::chrono::milliseconds(250);
+};
+
 } // namespace peppe
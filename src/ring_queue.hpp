@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace peppe {
+
+// FIFO backed by a growable circular buffer. Unlike std::deque it keeps its
+// storage when drained, so a queue in steady state never allocates.
+template<typename T>
+class RingQueue {
+public:
+    // Ctor
+    explicit RingQueue(std::size_t initial_capacity = 16)
+        : m_slots(std::max<std::size_t>(initial_capacity, 1)) {}
+
+    [[nodiscard]] bool empty() const { return m_size == 0; }
+    [[nodiscard]] std::size_t size() const { return m_size; }
+
+    void push_back(T&& value) {
+        if (m_size == m_slots.size()) {
+            grow();
+        }
+        m_slots[(m_head + m_size) % m_slots.size()] = std::move(value);
+        ++m_size;
+    }
+
+    [[nodiscard]] T& front() { return m_slots[m_head]; }
+    [[nodiscard]] const T& front() const { return m_slots[m_head]; }
+
+    void pop_front() {
+        m_slots[m_head] = T{};
+        m_head = (m_head + 1) % m_slots.size();
+        --m_size;
+    }
+
+    void clear() {
+        while (!empty()) {
+            pop_front();
+        }
+        m_head = 0;
+    }
+
+private:
+    void grow() {
+        std::vector<T> slots(m_slots.size() * 2);
+        for (std::size_t i = 0; i < m_size; ++i) {
+            slots[i] = std::move(m_slots[(m_head + i) % m_slots.size()]);
+        }
+        m_slots = std::move(slots);
+        m_head = 0;
+    }
+
+    std::vector<T> m_slots;
+    std::size_t m_head = 0;
+    std::size_t m_size = 0;
+};
+
+} // namespace peppe
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace peppe {
+
+// Stable reference to a slot map element. Once the element is erased the
+// slot's generation changes, so stale handles are detected instead of
+// aliasing the next element stored in the slot.
+struct SlotHandle {
+    static constexpr std::uint32_t invalid_index =
+        std::numeric_limits<std::uint32_t>::max();
+
+    std::uint32_t index = invalid_index;
+    std::uint32_t generation = 0;
+
+    [[nodiscard]] bool valid() const { return index != invalid_index; }
+    bool operator==(const SlotHandle&) const = default;
+};
+
+// Container with O(1) insertion, removal and lookup by handle. Elements are
+// kept contiguous (removal moves the last element in the hole), so
+// iterating over them is as fast as iterating over a vector.
+template<typename T>
+class SlotMap {
+public:
+    template<typename... Args>
+    SlotHandle emplace(Args&&... args) {
+        std::uint32_t index = m_free_head;
+        if (index == SlotHandle::invalid_index) {
+            index = std::uint32_t(m_slots.size());
+            m_slots.emplace_back();
+        }
+        else {
+            m_free_head = m_slots[index].position;
+        }
+
+        auto& slot = m_slots[index];
+        slot.position = std::uint32_t(m_values.size());
+        slot.occupied = true;
+        m_values.emplace_back(std::forward<Args>(args)...);
+        m_owners.push_back(index);
+        return SlotHandle{ .index = index, .generation = slot.generation };
+    }
+
+    // Returns false if the handle is stale
+    bool erase(SlotHandle handle) {
+        if (!contains(handle)) {
+            return false;
+        }
+        auto& slot = m_slots[handle.index];
+        const auto position = slot.position;
+
+        // Fill the hole with the last element
+        if (position + 1 != m_values.size()) {
+            m_values[position] = std::move(m_values.back());
+            m_owners[position] = m_owners.back();
+            m_slots[m_owners[position]].position = position;
+        }
+        m_values.pop_back();
+        m_owners.pop_back();
+
+        ++slot.generation;
+        slot.occupied = false;
+        slot.position = m_free_head;
+        m_free_head = handle.index;
+        return true;
+    }
+
+    [[nodiscard]] bool contains(SlotHandle handle) const {
+        return handle.index < m_slots.size() &&
+               m_slots[handle.index].occupied &&
+               m_slots[handle.index].generation == handle.generation;
+    }
+
+    // nullptr if the handle is stale
+    [[nodiscard]] T* get(SlotHandle handle) {
+        return contains(handle) ? &m_values[m_slots[handle.index].position]
+                                : nullptr;
+    }
+    [[nodiscard]] const T* get(SlotHandle handle) const {
+        return contains(handle) ? &m_values[m_slots[handle.index].position]
+                                : nullptr;
+    }
+
+    // Contiguous elements, in no particular order
+    [[nodiscard]] std::span<T> values() { return m_values; }
+    [[nodiscard]] std::span<const T> values() const { return m_values; }
+
+    [[nodiscard]] std::size_t size() const { return m_values.size(); }
+    [[nodiscard]] bool empty() const { return m_values.empty(); }
+
+private:
+    struct Slot {
+        // Position in m_values when occupied, next free slot otherwise
+        std::uint32_t position = SlotHandle::invalid_index;
+        std::uint32_t generation = 0;
+        bool occupied = false;
+    };
+
+    std::vector<T> m_values;
+    // Slot of every element of m_values
+    std::vector<std::uint32_t> m_owners;
+    std::vector<Slot> m_slots;
+    std::uint32_t m_free_head = SlotHandle::invalid_index;
+};
+
+} // namespace peppe
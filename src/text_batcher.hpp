@@ -0,0 +1,151 @@
+#pragma once
+
+#include <asio/post.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "chat_message.hpp"
+#include "connection_table.hpp"
+#include "gossip.hpp"
+#include "memory.hpp"
+#include "message.hpp"
+#include "outbound_queue.hpp"
+
+namespace peppe {
+
+struct BatchConfig {
+    // How long the first queued message waits for others to join its frame.
+    // Zero sends every message in its own frame.
+    std::chrono::microseconds flush_window = std::chrono::milliseconds(2);
+    // Pending text size that flushes the batch right away
+    std::size_t max_bytes = 16 * 1024;
+};
+
+// Coalesces outgoing text messages (in the spirit of TCP_CORK): the first
+// message arms a timer, everything queued until it fires or until
+// 'max_bytes' are pending is broadcast as a single TextBatch frame.
+// Pending texts are copied into a pool, whose blocks are reused once their
+// message is written.
+class TextBatcher {
+public:
+    // Ctor
+    TextBatcher(Strand strand, ConnectionTable& table, Gossip& gossip)
+        : m_connection_table_ref(table)
+        , m_gossip_ref(gossip)
+        , m_timer(std::move(strand)) {}
+    // Copy
+    TextBatcher(TextBatcher const&) = delete;
+    TextBatcher& operator=(TextBatcher const&) = delete;
+    // Move
+    TextBatcher(TextBatcher&&) = delete;
+    TextBatcher& operator=(TextBatcher&&) = delete;
+    // Dtor
+    ~TextBatcher() = default;
+
+    void set_config(const BatchConfig& config) {
+        std::lock_guard lock(m_mutex);
+        m_config = config;
+    }
+
+    // Name the messages are sent under
+    void set_origin(const std::string& origin) {
+        std::lock_guard lock(m_mutex);
+        m_origin = origin;
+    }
+
+    // Can be called from any thread
+    void push(std::string_view text) {
+        std::unique_lock lock(m_mutex);
+        if (m_config.flush_window.count() <= 0) {
+            broadcast(
+                lock, ChatMessage::create(make_header(), {}, { &text, 1 })
+            );
+            return;
+        }
+
+        m_pending_bytes += text.size();
+        m_pending.emplace_back(text);
+        if (m_pending_bytes >= m_config.max_bytes ||
+            m_pending.size() >= TextBatch::TextList::max_size) {
+            broadcast(lock, take_pending());
+        }
+        else if (!m_armed) {
+            m_armed = true;
+            const auto window = m_config.flush_window;
+            // The timer is only touched from its own strand. A single flush
+            // is armed at a time, they all reuse the same memory.
+            asio::post(
+                m_timer.get_executor(),
+                bind_memory(m_timer_memory, [this, window] { arm(window); })
+            );
+        }
+    }
+
+private:
+    void arm(std::chrono::microseconds window) {
+        m_timer.expires_after(window);
+        m_timer.async_wait(
+            bind_memory(m_timer_memory, [this](const asio::error_code&) {
+                std::unique_lock lock(m_mutex);
+                m_armed = false;
+                if (m_pending.empty()) {
+                    return;
+                }
+                broadcast(lock, take_pending());
+            })
+        );
+    }
+
+    // Every frame written locally starts a new gossip round. The origin is a
+    // view of 'm_origin', the header must be used under the lock.
+    GossipHeader make_header() {
+        return GossipHeader{
+            .id = m_gossip_ref.next_id(),
+            .ttl = m_gossip_ref.config().ttl,
+            .origin = m_origin,
+        };
+    }
+
+    // Messages are sent in the order they were built: the send lock is taken
+    // before the batch lock is released, so a flush can't overtake another
+    void broadcast(std::unique_lock<std::mutex>& lock, ChatMessagePtr message) {
+        std::lock_guard send_lock(m_send_mutex);
+        lock.unlock();
+        m_connection_table_ref.send_all(message->frame());
+    }
+
+    // Writes the pending texts into a message and clears them
+    ChatMessagePtr take_pending() {
+        m_views.assign(m_pending.begin(), m_pending.end());
+        auto message = ChatMessage::create(make_header(), {}, m_views);
+        m_views.clear();
+        m_pending.clear();
+        m_pending_bytes = 0;
+        return message;
+    }
+
+    ConnectionTable& m_connection_table_ref;
+    Gossip& m_gossip_ref;
+    StrandTimer m_timer;
+    HandlerMemory m_timer_memory;
+    std::mutex m_mutex;
+    // Taken after m_mutex, never before
+    std::mutex m_send_mutex;
+    BatchConfig m_config;
+    std::string m_origin;
+    // Only used under the lock, texts are copied out when flushed
+    std::pmr::unsynchronized_pool_resource m_pool;
+    std::pmr::vector<std::pmr::string> m_pending{ &m_pool };
+    std::vector<std::string_view> m_views;
+    std::size_t m_pending_bytes = 0;
+    bool m_armed = false;
+};
+
+} // namespace peppe
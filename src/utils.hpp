@@ -33,14 +33,6 @@ struct Variant : public std::variant<V...> {
     }
 };
 
-template<typename T>
-    requires std::is_arithmetic_v<T>
-[[nodiscard]] T reverse_bytes(T number) {
-    auto data = std::bit_cast<std::array<char, sizeof(T)>>(number);
-    std::ranges::reverse(data);
-    return std::bit_cast<T>(data);
-}
-
 [[nodiscard]] constexpr std::vector<std::string_view>
 split(std::string_view str, char separator) {
     uint32_t num_sparator = 0;
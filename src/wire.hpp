@@ -0,0 +1,553 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "error.hpp"
+#include "utils.hpp"
+
+namespace peppe {
+
+///////////////////////////////
+// Byte order                //
+///////////////////////////////
+
+template<std::integral T>
+[[nodiscard]] constexpr T byteswap(T value) {
+#if defined(__cpp_lib_byteswap)
+    return std::byteswap(value);
+#else
+    auto data = std::bit_cast<std::array<std::uint8_t, sizeof(T)>>(value);
+    std::ranges::reverse(data);
+    return std::bit_cast<T>(data);
+#endif
+}
+
+// Converts between host and network (big endian) byte order
+template<std::integral T>
+[[nodiscard]] constexpr T to_network(T value) {
+    if constexpr (std::endian::native == std::endian::little) {
+        return byteswap(value);
+    }
+    else {
+        return value;
+    }
+}
+
+template<std::integral T>
+[[nodiscard]] constexpr T from_network(T value) {
+    return to_network(value);
+}
+
+///////////////////////////////
+// Byte reader               //
+///////////////////////////////
+
+// Cursor over received bytes. Every read fails without consuming anything
+// when not enough bytes are available.
+class ByteReader {
+public:
+    explicit ByteReader(std::span<const std::uint8_t> bytes)
+        : m_bytes(bytes) {}
+
+    [[nodiscard]] std::size_t consumed() const { return m_offset; }
+    [[nodiscard]] std::size_t remaining() const {
+        return m_bytes.size() - m_offset;
+    }
+    void rewind(std::size_t offset) { m_offset = offset; }
+
+    template<typename T>
+        requires std::is_trivially_copyable_v<T>
+    [[nodiscard]] bool read(T& out) {
+        if (remaining() < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&out, m_bytes.data() + m_offset, sizeof(T));
+        m_offset += sizeof(T);
+        return true;
+    }
+
+    // View over the next 'size' bytes
+    [[nodiscard]] std::optional<std::span<const std::uint8_t>>
+    read_span(std::size_t size) {
+        if (remaining() < size) {
+            return std::nullopt;
+        }
+        auto result = m_bytes.subspan(m_offset, size);
+        m_offset += size;
+        return result;
+    }
+
+private:
+    std::span<const std::uint8_t> m_bytes;
+    std::size_t m_offset = 0;
+};
+
+///////////////////////////////
+// Wire types                //
+///////////////////////////////
+
+// A wire type describes how a value of type 'value_type' is laid out on the
+// wire:
+//   static std::size_t size(const value_type&);
+//   static std::uint8_t* encode(const value_type&, std::uint8_t* out);
+//   static bool decode(ByteReader&, value_type&);
+template<typename W>
+concept WireType =
+    requires(const typename W::value_type& cv,
+             typename W::value_type& v,
+             std::uint8_t* out,
+             ByteReader& reader) {
+        { W::size(cv) } -> std::same_as<std::size_t>;
+        { W::encode(cv, out) } -> std::same_as<std::uint8_t*>;
+        { W::decode(reader, v) } -> std::same_as<bool>;
+    };
+
+// Fixed-width integer (or enum) in network byte order
+template<typename T>
+    requires std::integral<T> || std::is_enum_v<T>
+struct BigEndian {
+    using value_type = T;
+
+    static constexpr std::size_t size(const T&) { return sizeof(T); }
+
+    static std::uint8_t* encode(const T& value, std::uint8_t* out) {
+        if constexpr (std::is_enum_v<T>) {
+            return BigEndian<std::underlying_type_t<T>>::encode(
+                static_cast<std::underlying_type_t<T>>(value), out
+            );
+        }
+        else {
+            const T net = to_network(value);
+            std::memcpy(out, &net, sizeof(T));
+            return out + sizeof(T);
+        }
+    }
+
+    static bool decode(ByteReader& reader, T& value) {
+        if constexpr (std::is_enum_v<T>) {
+            std::underlying_type_t<T> raw{};
+            if (!BigEndian<std::underlying_type_t<T>>::decode(reader, raw)) {
+                return false;
+            }
+            value = T(raw);
+            return true;
+        }
+        else {
+            T net{};
+            if (!reader.read(net)) {
+                return false;
+            }
+            value = from_network(net);
+            return true;
+        }
+    }
+};
+
+// Trivially copyable value sent as is (e.g. address bytes, already in
+// network order)
+template<typename T>
+    requires std::is_trivially_copyable_v<T>
+struct Raw {
+    using value_type = T;
+
+    static constexpr std::size_t size(const T&) { return sizeof(T); }
+
+    static std::uint8_t* encode(const T& value, std::uint8_t* out) {
+        std::memcpy(out, &value, sizeof(T));
+        return out + sizeof(T);
+    }
+
+    static bool decode(ByteReader& reader, T& value) {
+        return reader.read(value);
+    }
+};
+
+// String prefixed by its length. The length must fit in 'LenT', factories
+// are responsible for enforcing it.
+template<std::unsigned_integral LenT>
+struct String {
+    using value_type = std::string;
+    static constexpr std::size_t max_size = std::numeric_limits<LenT>::max();
+
+    static std::size_t size(const std::string& value) {
+        return sizeof(LenT) + value.size();
+    }
+
+    static std::uint8_t* encode(const std::string& value, std::uint8_t* out) {
+        out = BigEndian<LenT>::encode(LenT(value.size()), out);
+        std::memcpy(out, value.data(), value.size());
+        return out + value.size();
+    }
+
+    static bool decode(ByteReader& reader, std::string& value) {
+        LenT len = 0;
+        if (!BigEndian<LenT>::decode(reader, len)) {
+            return false;
+        }
+        const auto bytes = reader.read_span(len);
+        if (!bytes.has_value()) {
+            return false;
+        }
+        value.assign(reinterpret_cast<const char*>(bytes->data()), len);
+        return true;
+    }
+};
+
+// String prefixed by its length, decoded as a view over the received bytes
+// like BlobView
+template<std::unsigned_integral LenT>
+struct StringView {
+    using value_type = std::string_view;
+    static constexpr std::size_t max_size = std::numeric_limits<LenT>::max();
+
+    static std::size_t size(const value_type& value) {
+        return sizeof(LenT) + value.size();
+    }
+
+    static std::uint8_t* encode(const value_type& value, std::uint8_t* out) {
+        out = BigEndian<LenT>::encode(LenT(value.size()), out);
+        std::memcpy(out, value.data(), value.size());
+        return out + value.size();
+    }
+
+    static bool decode(ByteReader& reader, value_type& value) {
+        LenT len = 0;
+        if (!BigEndian<LenT>::decode(reader, len)) {
+            return false;
+        }
+        const auto bytes = reader.read_span(len);
+        if (!bytes.has_value()) {
+            return false;
+        }
+        value = std::string_view(
+            reinterpret_cast<const char*>(bytes->data()), len
+        );
+        return true;
+    }
+};
+
+// Opaque bytes prefixed by their length
+template<std::unsigned_integral LenT>
+struct Blob {
+    using value_type = std::vector<std::uint8_t>;
+    static constexpr std::size_t max_size = std::numeric_limits<LenT>::max();
+
+    static std::size_t size(const value_type& value) {
+        return sizeof(LenT) + value.size();
+    }
+
+    static std::uint8_t* encode(const value_type& value, std::uint8_t* out) {
+        out = BigEndian<LenT>::encode(LenT(value.size()), out);
+        return std::ranges::copy(value, out).out;
+    }
+
+    static bool decode(ByteReader& reader, value_type& value) {
+        LenT len = 0;
+        if (!BigEndian<LenT>::decode(reader, len)) {
+            return false;
+        }
+        const auto bytes = reader.read_span(len);
+        if (!bytes.has_value()) {
+            return false;
+        }
+        value.assign(bytes->begin(), bytes->end());
+        return true;
+    }
+};
+
+// Opaque bytes prefixed by their length, decoded as a view over the
+// received bytes instead of a copy. The view is only valid until the
+// receive buffer is reused.
+template<std::unsigned_integral LenT>
+struct BlobView {
+    using value_type = std::span<const std::uint8_t>;
+    static constexpr std::size_t max_size = std::numeric_limits<LenT>::max();
+
+    static std::size_t size(const value_type& value) {
+        return sizeof(LenT) + value.size();
+    }
+
+    static std::uint8_t* encode(const value_type& value, std::uint8_t* out) {
+        out = BigEndian<LenT>::encode(LenT(value.size()), out);
+        return std::ranges::copy(value, out).out;
+    }
+
+    static bool decode(ByteReader& reader, value_type& value) {
+        LenT len = 0;
+        if (!BigEndian<LenT>::decode(reader, len)) {
+            return false;
+        }
+        const auto bytes = reader.read_span(len);
+        if (!bytes.has_value()) {
+            return false;
+        }
+        value = *bytes;
+        return true;
+    }
+};
+
+// Sequence prefixed by its element count
+template<
+    WireType Elem,
+    std::unsigned_integral CountT,
+    typename Container = std::vector<typename Elem::value_type>>
+struct Vector {
+    using value_type = Container;
+    static constexpr std::size_t max_size = std::numeric_limits<CountT>::max();
+
+    static std::size_t size(const value_type& values) {
+        std::size_t result = sizeof(CountT);
+        for (const auto& value : values) {
+            result += Elem::size(value);
+        }
+        return result;
+    }
+
+    static std::uint8_t* encode(const value_type& values, std::uint8_t* out) {
+        out = BigEndian<CountT>::encode(CountT(values.size()), out);
+        for (const auto& value : values) {
+            out = Elem::encode(value, out);
+        }
+        return out;
+    }
+
+    static bool decode(ByteReader& reader, value_type& values) {
+        CountT count = 0;
+        if (!BigEndian<CountT>::decode(reader, count)) {
+            return false;
+        }
+        values.resize(count);
+        for (auto& value : values) {
+            if (!Elem::decode(reader, value)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Sequence prefixed by its element count, decoded as a view over the
+// received bytes like BlobView. The elements are checked when decoding and
+// decoded again while iterating, nothing is copied or allocated.
+template<WireType Elem, std::unsigned_integral CountT>
+struct VectorView {
+    static constexpr std::size_t max_size = std::numeric_limits<CountT>::max();
+
+    class value_type {
+    public:
+        // Holds the current element, like an istream iterator
+        class iterator {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = typename Elem::value_type;
+            using difference_type = std::ptrdiff_t;
+
+            iterator() = default;
+            iterator(std::span<const std::uint8_t> bytes, std::size_t left)
+                : m_bytes(bytes)
+                , m_left(left) {
+                load();
+            }
+
+            [[nodiscard]] const value_type& operator*() const {
+                return m_value;
+            }
+            iterator& operator++() {
+                --m_left;
+                load();
+                return *this;
+            }
+            iterator operator++(int) {
+                auto result = *this;
+                ++*this;
+                return result;
+            }
+            [[nodiscard]] bool operator==(const iterator& other) const {
+                return m_left == other.m_left;
+            }
+
+        private:
+            void load() {
+                if (m_left > 0) {
+                    ByteReader reader(m_bytes);
+                    (void)Elem::decode(reader, m_value);
+                    m_bytes = m_bytes.subspan(reader.consumed());
+                }
+            }
+
+            std::span<const std::uint8_t> m_bytes;
+            std::size_t m_left = 0;
+            value_type m_value{};
+        };
+
+        [[nodiscard]] iterator begin() const { return { m_bytes, m_count }; }
+        [[nodiscard]] iterator end() const { return {}; }
+        [[nodiscard]] std::size_t size() const { return m_count; }
+        [[nodiscard]] bool empty() const { return m_count == 0; }
+
+    private:
+        friend VectorView;
+
+        // Encoded elements, without the count
+        std::span<const std::uint8_t> m_bytes;
+        std::size_t m_count = 0;
+    };
+
+    static std::size_t size(const value_type& values) {
+        return sizeof(CountT) + values.m_bytes.size();
+    }
+
+    static std::uint8_t* encode(const value_type& values, std::uint8_t* out) {
+        out = BigEndian<CountT>::encode(CountT(values.m_count), out);
+        return std::ranges::copy(values.m_bytes, out).out;
+    }
+
+    static bool decode(ByteReader& reader, value_type& values) {
+        CountT count = 0;
+        if (!BigEndian<CountT>::decode(reader, count)) {
+            return false;
+        }
+        const auto begin = reader.consumed();
+        for (CountT i = 0; i < count; ++i) {
+            typename Elem::value_type value{};
+            if (!Elem::decode(reader, value)) {
+                return false;
+            }
+        }
+        const auto len = reader.consumed() - begin;
+        reader.rewind(begin);
+        values.m_bytes = *reader.read_span(len);
+        values.m_count = count;
+        return true;
+    }
+};
+
+///////////////////////////////
+// Message schema            //
+///////////////////////////////
+
+// Binds a message member to its wire type
+template<auto Member, WireType W>
+struct Field {
+    using wire_type = W;
+
+    static constexpr decltype(auto) get(const auto& msg) {
+        return msg.*Member;
+    }
+    static constexpr decltype(auto) get(auto& msg) { return msg.*Member; }
+};
+
+template<typename... Fields>
+struct Schema {};
+
+// A message declares its type tag and its fields once:
+//   static constexpr auto msg_type = MessageType::...;
+//   using schema = Schema<Field<&Msg::member, WireType>, ...>;
+template<typename M>
+concept Message = requires {
+    { M::msg_type };
+    typename M::schema;
+};
+
+template<Message M, typename S = typename M::schema>
+struct Codec;
+
+// Frame layout: [msg_type: u8][fields...]
+template<Message M, typename... Fields>
+struct Codec<M, Schema<Fields...>> {
+    [[nodiscard]] static std::size_t encoded_size(const M& msg) {
+        return sizeof(M::msg_type) +
+               (Fields::wire_type::size(Fields::get(msg)) + ... + 0);
+    }
+
+    static std::uint8_t* encode(const M& msg, std::uint8_t* out) {
+        out = BigEndian<decltype(M::msg_type)>::encode(M::msg_type, out);
+        ((out = Fields::wire_type::encode(Fields::get(msg), out)), ...);
+        return out;
+    }
+
+    // Decodes the fields following the type tag
+    [[nodiscard]] static std::optional<M> decode(ByteReader& reader) {
+        M result{};
+        const bool complete =
+            (Fields::wire_type::decode(reader, Fields::get(result)) && ...);
+        if (!complete) {
+            return std::nullopt;
+        }
+        return result;
+    }
+};
+
+// Set of messages sharing a connection. Generates the decode dispatch
+// table indexed by message type.
+template<Message... Msgs>
+struct MessageSet {
+    using Tag =
+        std::common_type_t<std::remove_cv_t<decltype(Msgs::msg_type)>...>;
+    static_assert(sizeof(Tag) == 1, "Message types are encoded on one byte");
+
+    template<typename P>
+    using DecodeFn = std::optional<P> (*)(ByteReader&);
+
+    template<typename P>
+    static constexpr std::array<DecodeFn<P>, 256> decode_table = [] {
+        std::array<DecodeFn<P>, 256> table{};
+        (
+            [&table] {
+                auto& slot = table[std::size_t(Msgs::msg_type)];
+                // Two messages with the same tag
+                if (slot != nullptr) {
+                    throw "Duplicated message type";
+                }
+                slot = [](ByteReader& reader) -> std::optional<P> {
+                    auto msg = Codec<Msgs>::decode(reader);
+                    if (!msg.has_value()) {
+                        return std::nullopt;
+                    }
+                    return P{ std::move(*msg) };
+                };
+            }(),
+            ...
+        );
+        return table;
+    }();
+
+    // Decodes the next frame in 'reader' into the packet type 'P'. Returns
+    // std::nullopt when the frame is not complete yet, nothing is consumed
+    // in that case. Unknown message types close the connection.
+    template<typename P>
+    [[nodiscard]] static std::optional<P> decode(ByteReader& reader) {
+        const auto start = reader.consumed();
+        Tag tag{};
+        if (!BigEndian<Tag>::decode(reader, tag)) {
+            return std::nullopt;
+        }
+
+        const auto decode_fn = decode_table<P>[std::size_t(tag)];
+        if (decode_fn == nullptr) {
+            throw UnknownMsg();
+        }
+        auto result = decode_fn(reader);
+        if (!result.has_value()) {
+            reader.rewind(start);
+        }
+        return result;
+    }
+};
+
+} // namespace peppe